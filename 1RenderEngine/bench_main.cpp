@@ -0,0 +1,406 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+#include "core/math/math_headers.h"
+#include "core/base/timer.h"
+#include "core/base/cpu.h"
+#include "function/render/rasterizer.h"
+#include "resource/model.h"
+#include "function/platform/camera.h"
+
+/*
+*  frame time benchmark
+*     every bundled asset is rendered along a fixed camera orbit with each shader and at each size,
+*     the report (json) has p50 / p99 of the frame time and of every pipeline stage
+*
+*     frame_ms	: wall time of clear + draw + resolve + present
+*     stages	: cpu time summed over the rasterizer's workers (Rasterizer::set_profiling), so with
+*				  several threads they can add up to more than the frame time
+*     present	: conversion of the frame buffer to 8 bit BGRA, what window_draw does per frame
+*     loads		: model load time and OBJ throughput, the mesh cache is off unless --mesh-cache
+*/
+
+struct bench_options
+{
+	std::string models_dir	= "./models";
+	std::string json_path;
+	std::vector<std::string> extra_models;
+	std::vector<std::pair<int, int> > sizes;
+	int frames				= 60;
+	int warmup				= 2;
+	int threads				= 0;
+	bool deferred			= false;
+	bool mesh_cache			= false;
+	bool guard_band			= true;
+};
+
+struct bench_asset
+{
+	std::string name;
+	std::string path;
+};
+
+struct bench_load
+{
+	std::string model;
+	uint64_t bytes;
+	double load_ms;
+	double texture_wait_ms;		// how long the maps kept streaming after the geometry was ready
+	bool cached;
+};
+
+struct bench_run
+{
+	std::string model;
+	std::string shader;
+	int width, height;
+	int triangles;
+	int vertices;
+	float shaded_per_pixel;
+	float vertex_reuse;
+	// triangles per frame by clipping outcome
+	double clip_accepted, clip_rejected, clip_clipped;
+
+	std::vector<double> frame_ms;
+	std::vector<double> vertex_ms, clip_ms, setup_ms, raster_ms, fragment_ms, present_ms;
+};
+
+static void print_usage()
+{
+	std::cerr <<
+		"usage: render_bench [options]\n"
+		"  --models <dir>          asset directory (./models)\n"
+		"  --model <file.obj>      also benchmark this mesh, can be repeated\n"
+		"  --size <w>x<h>          frame size, can be repeated (320x240 800x600 1920x1080)\n"
+		"  --frames <n>            measured frames per run (60)\n"
+		"  --warmup <n>            unmeasured frames per run (2)\n"
+		"  --threads <n>           rasterizer threads, 0 = all (0)\n"
+		"  --deferred              deferred shading\n"
+		"  --mesh-cache            load models through their .omesh cache\n"
+		"  --no-guard-band         clip every triangle crossing the viewport\n"
+		"  --json <file>           write the report there instead of stdout\n";
+}
+
+static bool parse_options(int argc, char** argv, bench_options& opt)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (arg == "--deferred")
+			opt.deferred = true;
+		else if (arg == "--mesh-cache")
+			opt.mesh_cache = true;
+		else if (arg == "--no-guard-band")
+			opt.guard_band = false;
+		else if (arg == "--models" && has_value)
+			opt.models_dir = argv[++i];
+		else if (arg == "--model" && has_value)
+			opt.extra_models.push_back(argv[++i]);
+		else if (arg == "--size" && has_value)
+		{
+			int w, h;
+			if (sscanf(argv[++i], "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0
+				|| w >= OEngine::Rasterizer::MAX_WINDOW_COORD || h >= OEngine::Rasterizer::MAX_WINDOW_COORD)
+				return false;
+			opt.sizes.push_back({ w, h });
+		}
+		else if (arg == "--frames" && has_value)
+			opt.frames = atoi(argv[++i]);
+		else if (arg == "--warmup" && has_value)
+			opt.warmup = atoi(argv[++i]);
+		else if (arg == "--threads" && has_value)
+			opt.threads = atoi(argv[++i]);
+		else if (arg == "--json" && has_value)
+			opt.json_path = argv[++i];
+		else
+			return false;
+	}
+
+	if (opt.sizes.empty())
+		opt.sizes = { { 320, 240 }, { 800, 600 }, { 1920, 1080 } };
+
+	return opt.frames > 0 && opt.warmup >= 0;
+}
+
+// nearest rank percentile
+static double percentile(std::vector<double> values, double p)
+{
+	if (values.empty())
+		return 0;
+	std::sort(values.begin(), values.end());
+	size_t rank = (size_t)std::ceil(p / 100.0 * values.size());
+	return values[std::min(values.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+static bool file_exists(const std::string& path)
+{
+	std::ifstream file(path);
+	return file.good();
+}
+
+// what window_draw does with the frame buffer, minus the blit
+static void present(const std::vector<OEngine::Vector3>& framebuffer, std::vector<unsigned char>& window_fb)
+{
+	window_fb.resize(framebuffer.size() * 4);
+	for (size_t i = 0; i < framebuffer.size(); i++)
+	{
+		window_fb[i * 4 + 0] = static_cast<unsigned char>(framebuffer[i].z);
+		window_fb[i * 4 + 1] = static_cast<unsigned char>(framebuffer[i].y);
+		window_fb[i * 4 + 2] = static_cast<unsigned char>(framebuffer[i].x);
+		window_fb[i * 4 + 3] = 255;
+	}
+}
+
+static bench_run run_bench(const bench_options& opt, const std::string& name, OEngine::Model::Ptr model,
+	OEngine::ShaderProgram::Ptr shader, const std::string& shader_name, int width, int height)
+{
+	bench_run run;
+	run.model = name;
+	run.shader = shader_name;
+	run.width = width;
+	run.height = height;
+	run.triangles = model->nfaces();
+	run.vertices = model->nverts();
+	run.shaded_per_pixel = 0;
+	run.vertex_reuse = 0;
+	run.clip_accepted = run.clip_rejected = run.clip_clipped = 0;
+
+	auto r = std::make_shared<OEngine::Rasterizer>(width, height, opt.threads);
+	r->set_deferred(opt.deferred);
+	r->set_guard_band(opt.guard_band);
+	r->set_profiling(true);
+
+	auto camera = std::make_shared<OEngine::Camera>(OEngine::Vector3(0, 1, 5), OEngine::Vector3(0, 1, 0), OEngine::Vector3(0, 1, 0), (float)width / height);
+	shader->m_uniform.camera = camera;
+
+	OEngine::Matrix4x4 projection = OEngine::Math::makePerspectiveMatrix(OEngine::Radian(OEngine::Degree(45.f)), camera->aspect, -0.1, -100);
+	std::vector<unsigned char> window_fb;
+
+	for (int frame = 0; frame < opt.warmup + opt.frames; frame++)
+	{
+		// one full orbit over the measured frames
+		float angle = 2.f * OEngine::Math_PI * (float)frame / opt.frames;
+		camera->m_eye = camera->m_target + OEngine::Vector3(5.f * std::sin(angle), 0.f, 5.f * std::cos(angle));
+
+		OEngine::Matrix4x4 view = OEngine::Math::makeLookAtMatrix(camera->m_eye, camera->m_target, camera->m_up);
+		if (model->is_skybox)
+		{
+			// the skybox follows the camera, only its rotation is kept
+			view[0][3] = 0;
+			view[1][3] = 0;
+			view[2][3] = 0;
+		}
+		shader->m_view = view;
+		shader->m_mvp = projection * view;
+
+		OEngine::Timer timer(true);
+
+		r->clear(OEngine::Buffers::Color | OEngine::Buffers::Depth);
+		r->draw(model, shader);
+		r->resolve();
+
+		double present_start = timer.elapsed_ms();
+		present(r->frame_buffer(), window_fb);
+		double frame_ms = timer.elapsed_ms();
+
+		if (frame < opt.warmup)
+			continue;
+
+		OEngine::FrameStats stats = r->frame_stats();
+		run.frame_ms.push_back(frame_ms);
+		run.vertex_ms.push_back(stats.vertex_ms);
+		run.clip_ms.push_back(stats.clip_ms);
+		run.setup_ms.push_back(stats.setup_ms);
+		run.raster_ms.push_back(stats.raster_ms);
+		run.fragment_ms.push_back(stats.fragment_ms);
+		run.present_ms.push_back(frame_ms - present_start);
+		run.shaded_per_pixel += stats.shaded_per_pixel() / opt.frames;
+		run.vertex_reuse = stats.vertex_reuse();
+		run.clip_accepted += (double)stats.triangles_accepted / opt.frames;
+		run.clip_rejected += (double)stats.triangles_rejected / opt.frames;
+		run.clip_clipped += (double)stats.triangles_clipped / opt.frames;
+	}
+
+	return run;
+}
+
+static void write_percentiles(std::ostream& out, const char* name, const std::vector<double>& values, bool last = false)
+{
+	char buf[160];
+	snprintf(buf, sizeof(buf), "\"%s\": { \"p50\": %.4f, \"p99\": %.4f }%s", name,
+		percentile(values, 50), percentile(values, 99), last ? "" : ", ");
+	out << buf;
+}
+
+static std::string json_string(const std::string& s)
+{
+	std::string result = "\"";
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\')
+			result += '\\';
+		result += c;
+	}
+	return result + "\"";
+}
+
+static void write_report(std::ostream& out, const bench_options& opt, const std::vector<bench_load>& loads,
+	const std::vector<bench_run>& runs, const std::vector<std::pair<std::string, std::string> >& skipped)
+{
+	const char* simd_names[] = { "scalar", "sse2", "avx2" };
+
+	out << "{\n";
+	out << "  \"simd\": \"" << simd_names[(int)OEngine::cpu_simd_level()] << "\",\n";
+	out << "  \"threads\": " << opt.threads << ",\n";
+	out << "  \"deferred\": " << (opt.deferred ? "true" : "false") << ",\n";
+	out << "  \"guard_band\": " << (opt.guard_band ? "true" : "false") << ",\n";
+	out << "  \"frames\": " << opt.frames << ",\n";
+	out << "  \"loads\": [\n";
+	for (size_t i = 0; i < loads.size(); i++)
+	{
+		const bench_load& load = loads[i];
+		double mb = load.bytes / (1024.0 * 1024.0);
+		char buf[200];
+		snprintf(buf, sizeof(buf), "\"mb\": %.2f, \"load_ms\": %.2f, \"mb_per_s\": %.1f, \"texture_wait_ms\": %.2f, \"cached\": %s }",
+			mb, load.load_ms, load.load_ms > 0 ? mb / (load.load_ms / 1000.0) : 0.0, load.texture_wait_ms, load.cached ? "true" : "false");
+		out << "    { \"model\": " << json_string(load.model) << ", " << buf << (i + 1 < loads.size() ? "," : "") << "\n";
+	}
+	out << "  ],\n";
+	out << "  \"runs\": [\n";
+	for (size_t i = 0; i < runs.size(); i++)
+	{
+		const bench_run& run = runs[i];
+		char buf[64];
+
+		out << "    { \"model\": " << json_string(run.model) << ", \"shader\": \"" << run.shader << "\", ";
+		out << "\"width\": " << run.width << ", \"height\": " << run.height << ", \"triangles\": " << run.triangles << ", \"vertices\": " << run.vertices << ", ";
+		snprintf(buf, sizeof(buf), "%.3f", run.shaded_per_pixel);
+		out << "\"shaded_per_pixel\": " << buf << ", ";
+		snprintf(buf, sizeof(buf), "%.3f", run.vertex_reuse);
+		out << "\"vertex_reuse\": " << buf << ",\n      ";
+		snprintf(buf, sizeof(buf), "%.0f, \"rejected\": %.0f, \"clipped\": %.0f", run.clip_accepted, run.clip_rejected, run.clip_clipped);
+		out << "\"clip_triangles\": { \"accepted\": " << buf << " },\n      ";
+		write_percentiles(out, "frame_ms", run.frame_ms);
+		out << "\n      \"stages_ms\": { ";
+		write_percentiles(out, "vertex", run.vertex_ms);
+		write_percentiles(out, "clip", run.clip_ms);
+		write_percentiles(out, "setup", run.setup_ms);
+		out << "\n                     ";
+		write_percentiles(out, "raster", run.raster_ms);
+		write_percentiles(out, "fragment", run.fragment_ms);
+		write_percentiles(out, "present", run.present_ms, true);
+		out << " } }" << (i + 1 < runs.size() ? "," : "") << "\n";
+	}
+	out << "  ],\n";
+	out << "  \"skipped\": [\n";
+	for (size_t i = 0; i < skipped.size(); i++)
+	{
+		out << "    { \"model\": " << json_string(skipped[i].first) << ", \"reason\": " << json_string(skipped[i].second) << " }"
+			<< (i + 1 < skipped.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n";
+	out << "}\n";
+}
+
+int main(int argc, char** argv)
+{
+	bench_options opt;
+	if (!parse_options(argc, argv, opt))
+	{
+		print_usage();
+		return 1;
+	}
+
+	// the bundled assets, same layout as "./models/helmet/helmet.obj" in main.cpp
+	std::vector<bench_asset> assets = {
+		{ "helmet",	opt.models_dir + "/helmet/helmet.obj" },
+		{ "gun",	opt.models_dir + "/gun/gun.obj" },
+		{ "spot",	opt.models_dir + "/spot/spot.obj" },
+		{ "rock",	opt.models_dir + "/rock/rock.obj" },
+		{ "crate",	opt.models_dir + "/Crate/Crate1.obj" },
+		{ "cube",	opt.models_dir + "/cube/cube.obj" },
+	};
+	for (const auto& path : opt.extra_models)
+		assets.push_back({ path, path });
+
+	OEngine::Model::set_mesh_cache(opt.mesh_cache);
+
+	std::vector<bench_load> loads;
+	std::vector<bench_run> runs;
+	std::vector<std::pair<std::string, std::string> > skipped;
+
+	for (const auto& asset : assets)
+	{
+		if (!file_exists(asset.path))
+		{
+			skipped.push_back({ asset.name, "missing " + asset.path });
+			continue;
+		}
+
+		auto model = std::make_shared<OEngine::Model>(asset.path.c_str());
+		if (model->nfaces() == 0)
+		{
+			skipped.push_back({ asset.name, "no faces in " + asset.path });
+			continue;
+		}
+
+		// frames are timed with every map resident
+		OEngine::Timer texture_timer(true);
+		model->wait_all();
+
+		const OEngine::mesh_load_stats& load = model->load_stats();
+		loads.push_back({ asset.name, load.source_bytes, load.load_ms, texture_timer.elapsed_ms(), load.from_cache });
+
+		auto phong = std::make_shared<OEngine::PhongShader>();
+		auto pbr = std::make_shared<OEngine::PBRShader>();
+		for (OEngine::ShaderProgram::Ptr shader : { (OEngine::ShaderProgram::Ptr)phong, (OEngine::ShaderProgram::Ptr)pbr })
+		{
+			shader->m_uniform.model = model;
+			shader->m_light.position = OEngine::Vector3(0, 0, 1);
+			shader->m_light.intensity = OEngine::Vector3(500, 500, 500);
+		}
+
+		for (const auto& size : opt.sizes)
+		{
+			runs.push_back(run_bench(opt, asset.name, model, phong, "phong", size.first, size.second));
+			runs.push_back(run_bench(opt, asset.name, model, pbr, "pbr", size.first, size.second));
+		}
+	}
+
+	// the skybox shader only draws the cubemap box
+	std::string skybox_path = opt.models_dir + "/skybox2/box.obj";
+	if (file_exists(skybox_path))
+	{
+		auto skybox = std::make_shared<OEngine::Model>(skybox_path.c_str(), 1);
+		auto shader = std::make_shared<OEngine::SkyBoxShader>();
+		shader->m_uniform.model = skybox;
+
+		for (const auto& size : opt.sizes)
+			runs.push_back(run_bench(opt, "skybox2", skybox, shader, "skybox", size.first, size.second));
+	}
+	else
+		skipped.push_back({ "skybox2", "missing " + skybox_path });
+
+	if (opt.json_path.empty())
+		write_report(std::cout, opt, loads, runs, skipped);
+	else
+	{
+		std::ofstream out(opt.json_path);
+		write_report(out, opt, loads, runs, skipped);
+		if (!out.good())
+		{
+			std::cerr << "report write failed..." << opt.json_path << '\n';
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/*
+*  read-only (pointer, count) view of a contiguous array
+*     does not own the elements, the vector or mapped file behind it must outlive the view
+*/
+
+namespace OEngine
+{
+	template <typename T>
+	class ArrayView
+	{
+	public:
+		ArrayView() = default;
+		ArrayView(const T* data, size_t size) : m_data(data), m_size(size) {}
+		ArrayView(const std::vector<T>& vec) : m_data(vec.data()), m_size(vec.size()) {}
+
+		const T* data() const { return m_data; }
+		size_t size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+
+		const T& operator[](size_t i) const { return m_data[i]; }
+		const T* begin() const { return m_data; }
+		const T* end() const { return m_data + m_size; }
+
+	private:
+		const T* m_data = nullptr;
+		size_t m_size = 0;
+	};
+} // OEngine
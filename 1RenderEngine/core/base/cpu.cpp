@@ -0,0 +1,49 @@
+#include "cpu.h"
+
+#if defined(OENGINE_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace OEngine
+{
+	static SimdLevel detect_simd_level()
+	{
+#if !defined(OENGINE_X86)
+		return SimdLevel::Scalar;
+#elif defined(_MSC_VER) && !defined(__clang__)
+		int regs[4];
+		__cpuid(regs, 0);
+		int max_leaf = regs[0];
+
+		__cpuid(regs, 1);
+		bool sse2 = (regs[3] & (1 << 26)) != 0;
+		bool osxsave = (regs[2] & (1 << 27)) != 0;
+		bool avx = (regs[2] & (1 << 28)) != 0;
+
+		bool avx2 = false;
+		// the os has to save the ymm registers on context switch
+		if (max_leaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+		{
+			__cpuidex(regs, 7, 0);
+			avx2 = (regs[1] & (1 << 5)) != 0;
+		}
+
+		if (avx2) return SimdLevel::AVX2;
+		if (sse2) return SimdLevel::SSE2;
+		return SimdLevel::Scalar;
+#else
+		// also checks that the os enabled the ymm state
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+		if (__builtin_cpu_supports("sse2")) return SimdLevel::SSE2;
+		return SimdLevel::Scalar;
+#endif
+	}
+
+	SimdLevel cpu_simd_level()
+	{
+		static const SimdLevel level = detect_simd_level();
+		return level;
+	}
+} // OEngine
@@ -0,0 +1,31 @@
+#pragma once
+
+/*
+*  runtime cpu feature detection
+*     SIMD code paths are compiled with a per-function target, the best one the cpu supports
+*     is picked once at startup, so the binary itself keeps the baseline instruction set
+*/
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define OENGINE_X86 1
+#endif
+
+// enables an instruction set for a single function (MSVC allows intrinsics everywhere)
+#if defined(_MSC_VER) && !defined(__clang__)
+#define OENGINE_TARGET(isa)
+#else
+#define OENGINE_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace OEngine
+{
+	enum class SimdLevel
+	{
+		Scalar = 0,
+		SSE2,
+		AVX2
+	};
+
+	// highest level supported by both the cpu and the os
+	SimdLevel cpu_simd_level();
+} // OEngine
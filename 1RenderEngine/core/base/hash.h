@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/*
+*  non-cryptographic 64 bit hash for cache validation
+*     four independent lanes over 32 byte blocks so large files hash at memory speed,
+*     the value is the same on every platform (little endian loads)
+*/
+
+namespace OEngine
+{
+	namespace hash_detail
+	{
+		static const uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+		static const uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+		static const uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
+
+		inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+		inline uint64_t load64(const unsigned char* p)
+		{
+			uint64_t v = 0;
+			for (int i = 0; i < 8; i++)
+				v |= (uint64_t)p[i] << (8 * i);
+			return v;
+		}
+
+		inline uint64_t lane_round(uint64_t acc, uint64_t input)
+		{
+			acc += input * PRIME_2;
+			acc = rotl(acc, 31);
+			return acc * PRIME_1;
+		}
+
+		inline uint64_t mix(uint64_t h)
+		{
+			h ^= h >> 33;
+			h *= PRIME_2;
+			h ^= h >> 29;
+			h *= PRIME_3;
+			h ^= h >> 32;
+			return h;
+		}
+	} // hash_detail
+
+	inline uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0)
+	{
+		using namespace hash_detail;
+
+		const unsigned char* p = (const unsigned char*)data;
+		const unsigned char* end = p + size;
+
+		uint64_t lane[4] = { seed + PRIME_1 + PRIME_2, seed + PRIME_2, seed, seed - PRIME_1 };
+		for (; end - p >= 32; p += 32)
+			for (int i = 0; i < 4; i++)
+				lane[i] = lane_round(lane[i], load64(p + 8 * i));
+
+		uint64_t h = rotl(lane[0], 1) + rotl(lane[1], 7) + rotl(lane[2], 12) + rotl(lane[3], 18);
+		h += (uint64_t)size;
+
+		for (; end - p >= 8; p += 8)
+			h = rotl(h ^ lane_round(0, load64(p)), 27) * PRIME_1 + PRIME_3;
+		for (; p < end; p++)
+			h = rotl(h ^ (*p * PRIME_3), 11) * PRIME_1;
+
+		return mix(h);
+	}
+} // OEngine
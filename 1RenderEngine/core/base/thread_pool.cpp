@@ -0,0 +1,109 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace OEngine
+{
+	// pool that owns the current thread, and the thread's slot in it
+	static thread_local const ThreadPool* t_owner = nullptr;
+	static thread_local int t_worker_id = -1;
+
+	ThreadPool::ThreadPool(int num_threads)
+	{
+		if (num_threads < 0)
+			num_threads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+
+		for (int i = 0; i < num_threads; i++)
+			m_workers.emplace_back(&ThreadPool::worker_loop, this, i);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_cond.notify_all();
+		for (auto& worker : m_workers)
+			worker.join();
+	}
+
+	int ThreadPool::worker_id() const
+	{
+		return t_owner == this ? t_worker_id : size();
+	}
+
+	void ThreadPool::push(std::function<void()> task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_tasks.push_back(std::move(task));
+		}
+		m_cond.notify_one();
+	}
+
+	void ThreadPool::worker_loop(int id)
+	{
+		t_owner = this;
+		t_worker_id = id;
+
+		for (;;)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_cond.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+				if (m_stop && m_tasks.empty())
+					return;
+				task = std::move(m_tasks.front());
+				m_tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	void ThreadPool::parallel_for(int begin, int end, const std::function<void(int, int)>& func)
+	{
+		if (begin >= end)
+			return;
+
+		// shared with the helpers, which may still be queued after the loop has finished
+		struct loop_state
+		{
+			std::atomic<int> next;
+			std::atomic<int> remaining;
+			std::mutex mutex;
+			std::condition_variable done;
+		};
+		auto state = std::make_shared<loop_state>();
+		state->next = begin;
+		state->remaining = end - begin;
+
+		auto run = [state, end, &func](int worker)
+		{
+			for (int i = state->next++; i < end; i = state->next++)
+			{
+				func(i, worker);
+				if (--state->remaining == 0)
+				{
+					std::lock_guard<std::mutex> lock(state->mutex);
+					state->done.notify_all();
+				}
+			}
+		};
+
+		// func is only touched while items remain, so helpers starting late never see a dangling reference
+		int helpers = std::min(size(), end - begin - 1);
+		for (int i = 0; i < helpers; i++)
+			push([this, state, end, run]()
+			{
+				if (state->next.load() < end)
+					run(worker_id());
+			});
+
+		run(worker_id());
+
+		std::unique_lock<std::mutex> lock(state->mutex);
+		state->done.wait(lock, [&state]() { return state->remaining.load() == 0; });
+	}
+} // OEngine
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+*  fixed size worker pool
+*     submit		: queue a single task, returns a future of its result
+*     parallel_for	: run func(i, worker_id) for every i in [begin, end)
+*					  the calling thread takes part in the loop, so nested calls never dead-lock
+*     worker_id		: [0, size()) for pool threads, size() for any other thread
+*/
+
+namespace OEngine
+{
+	class ThreadPool
+	{
+	public:
+		typedef std::shared_ptr<ThreadPool> Ptr;
+
+		// num_threads < 0 : one worker per hardware thread except the caller
+		explicit ThreadPool(int num_threads = -1);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		int size() const { return (int)m_workers.size(); }
+
+		// index of the calling thread, used to pick per-worker scratch data
+		int worker_id() const;
+
+		template <typename F>
+		auto submit(F&& func) -> std::future<decltype(func())>
+		{
+			typedef decltype(func()) result_t;
+			auto task = std::make_shared<std::packaged_task<result_t()> >(std::forward<F>(func));
+			std::future<result_t> result = task->get_future();
+			push([task]() { (*task)(); });
+			return result;
+		}
+
+		void parallel_for(int begin, int end, const std::function<void(int, int)>& func);
+
+	private:
+		void push(std::function<void()> task);
+		void worker_loop(int id);
+
+	private:
+		std::vector<std::thread> m_workers;
+		std::deque<std::function<void()> > m_tasks;
+		std::mutex m_mutex;
+		std::condition_variable m_cond;
+		bool m_stop = false;
+	};
+} // OEngine
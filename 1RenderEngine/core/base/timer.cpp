@@ -18,11 +18,26 @@ namespace OEngine
 		}
 	}
 
-	float Timer::duration()
+	void Timer::stop()
+	{
+		m_started = false;
+	}
+
+	void Timer::reset()
 	{
-		auto dur = std::chrono::steady_clock::now() - m_reference;
 		m_reference = std::chrono::steady_clock::now();
-		dur = std::chrono::duration_cast<std::chrono::milliseconds>(dur);
-		return dur.count() / 1000000000.0f;
+	}
+
+	float Timer::duration()
+	{
+		auto now = std::chrono::steady_clock::now();
+		std::chrono::duration<float> dur = now - m_reference;
+		m_reference = now;
+		return dur.count();
+	}
+
+	double Timer::elapsed_ms() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_reference).count();
 	}
 } // OEngine
\ No newline at end of file
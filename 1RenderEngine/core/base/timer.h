@@ -30,8 +30,12 @@ namespace OEngine
 
 		void reset();
 
+		// seconds since the last call (or start), restarts the clock
 		float duration();
 
+		// milliseconds since the last start / reset, leaves the clock running
+		double elapsed_ms() const;
+
 	private:
 		bool m_started;
 		std::chrono::steady_clock::time_point m_reference;
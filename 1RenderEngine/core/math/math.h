@@ -5,6 +5,8 @@
 */
 
 #include <cmath>
+#include <cfloat>
+#include <cstring>
 #include <limits>
 #include <stdint.h>
 #include <vector>
@@ -225,7 +227,7 @@ namespace OEngine {
         Math();
 
         static float abs(float value) { return float(fabs(value)); }
-        static bool isNan(float f) { return std::isnan<float>(f); }
+        static bool isNan(float f) { return std::isnan(f); }
         static float sqr(float value) { return value * value; }
         static float sqrt(float value) { return (float)::sqrt(value); }
         static float invSqrt(float value) { return 1.0f / sqrt(value); }
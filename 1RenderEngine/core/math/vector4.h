@@ -50,7 +50,7 @@ namespace OEngine
 	
 		Vector4 operator+(const Vector4& rhs) const { return Vector4(x + rhs.x, y + rhs.y, z + rhs.z, w + rhs.w); }
 
-		Vector4 operator-(const Vector4& rhs) const { return Vector4(x - rhs.x, y + rhs.y, z + rhs.z, w + rhs.w); }
+		Vector4 operator-(const Vector4& rhs) const { return Vector4(x - rhs.x, y - rhs.y, z - rhs.z, w - rhs.w); }
 
 		Vector4 operator*(const Vector4& rhs) const { return Vector4(x * rhs.x, y * rhs.y, z * rhs.z, w * rhs.w); }
 
@@ -96,12 +96,12 @@ namespace OEngine
 
 		friend Vector4 operator-(const float lhs, const Vector4& rhs)
 		{
-			return Vector4(lhs + rhs.x, lhs + rhs.y, lhs + rhs.z, lhs + rhs.w);
+			return Vector4(lhs - rhs.x, lhs - rhs.y, lhs - rhs.z, lhs - rhs.w);
 		}
 
 		friend Vector4 operator-(const Vector4& lhs, const float rhs)
 		{
-			return Vector4(lhs.x + rhs, lhs.y + rhs, lhs.z + rhs, lhs.w + rhs);
+			return Vector4(lhs.x - rhs, lhs.y - rhs, lhs.z - rhs, lhs.w - rhs);
 		}
 
 		// Ԫ
@@ -0,0 +1,67 @@
+#include "./headless.h"
+#include "../../resource/tgaimage.h"
+
+#include <cstdio>
+
+namespace OEngine
+{
+	static unsigned char to_byte(float value)
+	{
+		return (unsigned char)Math::clamp(value, 0.f, 255.f);
+	}
+
+	std::string frame_path(const std::string& dir, const std::string& prefix, int frame, ImageFormat format)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "_%04d.%s", frame, format == ImageFormat::TGA ? "tga" : "ppm");
+		return (dir.empty() ? std::string() : dir + "/") + prefix + name;
+	}
+
+	static bool write_tga(const std::string& path, const std::vector<Vector3>& framebuffer, int width, int height)
+	{
+		TGAImage image(width, height, TGAImage::RGB);
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				const Vector3& color = framebuffer[y * width + x];
+				image.set(x, y, TGAColor(to_byte(color.x), to_byte(color.y), to_byte(color.z)));
+			}
+		}
+		return image.write_tga_file(path.c_str());
+	}
+
+	static bool write_ppm(const std::string& path, const std::vector<Vector3>& framebuffer, int width, int height)
+	{
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file)
+			return false;
+
+		fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+		std::vector<unsigned char> row(width * 3);
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				const Vector3& color = framebuffer[y * width + x];
+				row[x * 3 + 0] = to_byte(color.x);
+				row[x * 3 + 1] = to_byte(color.y);
+				row[x * 3 + 2] = to_byte(color.z);
+			}
+			fwrite(row.data(), 1, row.size(), file);
+		}
+
+		return fclose(file) == 0;
+	}
+
+	bool image_write(const std::string& path, const std::vector<Vector3>& framebuffer, int width, int height, ImageFormat format)
+	{
+		if ((int)framebuffer.size() != width * height)
+			return false;
+
+		if (format == ImageFormat::TGA)
+			return write_tga(path, framebuffer, width, height);
+		return write_ppm(path, framebuffer, width, height);
+	}
+} // OEngine
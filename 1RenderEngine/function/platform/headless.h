@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "../../core/math/math_headers.h"
+
+/*
+*  offscreen stand-in for win32.h
+*     frames go to image files instead of a window, read the same way window_draw reads them :
+*     row 0 at the top, rgb in [0, 255]
+*/
+
+namespace OEngine
+{
+	enum class ImageFormat
+	{
+		TGA,
+		PPM
+	};
+
+	// "<dir>/<prefix>_0042.tga"
+	std::string frame_path(const std::string& dir, const std::string& prefix, int frame, ImageFormat format);
+
+	bool image_write(const std::string& path, const std::vector<Vector3>& framebuffer, int width, int height, ImageFormat format);
+} // OEngine
@@ -0,0 +1,732 @@
+#include "./ibl.h"
+#include "./sampler.h"
+#include "../../core/base/thread_pool.h"
+#include "../../core/base/hash.h"
+#include "../../core/base/mapped_file.h"
+#include "../../core/base/timer.h"
+#include "../../resource/hdr_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace OEngine
+{
+	static float radicalInverse_VdC(unsigned int bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return float(bits) * 2.3283064365386963e-10; // / 0x100000000
+	}
+
+	static Vector2 hammersley2d(unsigned int i, unsigned int N)
+	{
+		return Vector2(float(i) / float(N), radicalInverse_VdC(i));
+	}
+
+	// GGX distributed half vector around +z
+	static Vector3 importance_sample_GGX(Vector2 Xi, float roughness)
+	{
+		float a = roughness * roughness;
+
+		float phi = 2.0 * Math_PI * Xi.x;
+		float cosTheta = sqrt((1.0 - Xi.y) / (1.0 + (a * a - 1.0) * Xi.y));
+		float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+
+		return Vector3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
+	}
+
+	// tangent frame of N for the GGX samples
+	static void GGX_frame(const Vector3& N, Vector3& tangent, Vector3& bitangent)
+	{
+		Vector3 up = std::fabs(N.z) < 0.999f ? Vector3(0.0f, 0.0f, 1.0f) : Vector3(1.0f, 0.0f, 0.0f);
+		tangent = up.crossProduct(N).normalizedCopy();
+		bitangent = N.crossProduct(tangent);
+	}
+
+	static float SchlickGGX_geometry(float n_dot_v, float roughness)
+	{
+		float k = roughness * roughness / 2.0f;
+		return n_dot_v / (n_dot_v * (1 - k) + k);
+	}
+
+	static float geometry_Smith(float n_dot_v, float n_dot_l, float roughness)
+	{
+		float g1 = SchlickGGX_geometry(n_dot_v, roughness);
+		float g2 = SchlickGGX_geometry(n_dot_l, roughness);
+
+		return g1 * g2;
+	}
+
+	// direction through texel (x, y) of a face, length : face size - 1
+	static Vector3 face_direction(int face_id, float x, float y, float length)
+	{
+		switch (face_id)
+		{
+		case 0:   //positive x (right face)
+			return Vector3(0.5f, -0.5f + y / length, -0.5f + x / length);
+		case 1:   //negative x (left face)
+			return Vector3(-0.5f, -0.5f + y / length, 0.5f - x / length);
+		case 2:   //positive y (top face)
+			return Vector3(-0.5f + x / length, 0.5f, -0.5f + y / length);
+		case 3:   //negative y (bottom face)
+			return Vector3(-0.5f + x / length, -0.5f, 0.5f - y / length);
+		case 4:   //positive z (back face)
+			return Vector3(0.5f - x / length, -0.5f + y / length, 0.5f);
+		default:  //negative z (front face)
+			return Vector3(-0.5f + x / length, -0.5f + y / length, -0.5f);
+		}
+	}
+
+	/*
+	*  per texel integrals, the sample directions are tabulated once in tangent space
+	*/
+	static Vector3 prefilter_texel(cubemap_t* environment, const Vector3& normal, const std::vector<Vector3>& half_vectors)
+	{
+		Vector3 tangent, bitangent;
+		GGX_frame(normal, tangent, bitangent);
+		const Vector3& v = normal;
+
+		Vector3 prefilter_color(0, 0, 0);
+		float total_weight = 0.0f;
+		for (const Vector3& H : half_vectors)
+		{
+			Vector3 h = (tangent * H.x + bitangent * H.y + normal * H.z).normalizedCopy();
+			Vector3 l = (2.f * v.dotProduct(h) * h - v).normalizedCopy();
+
+			float n_dot_l = normal.dotProduct(l);
+			if (n_dot_l > 0)
+			{
+				prefilter_color += cubemap_sample(l, environment) * n_dot_l;
+				total_weight += n_dot_l;
+			}
+		}
+		return total_weight > 0.f ? prefilter_color / total_weight : prefilter_color;
+	}
+
+	// xyz : tangent space direction, w : sin(theta) * cos(theta)
+	static Vector3 irradiance_texel(cubemap_t* environment, const Vector3& normal, const std::vector<Vector4>& samples)
+	{
+		Vector3 up = std::fabs(normal[1]) < 0.999f ? Vector3(0.0f, 1.0f, 0.0f) : Vector3(0.0f, 0.0f, 1.0f);
+		Vector3 right = up.crossProduct(normal).normalizedCopy();
+		up = normal.crossProduct(right);
+
+		Vector3 irradiance(0, 0, 0);
+		for (const Vector4& s : samples)
+		{
+			Vector3 sampleVec = (s.x * right + s.y * up + s.z * normal).normalizedCopy();
+			irradiance += cubemap_sample(sampleVec, environment) * s.w;
+		}
+		return Math_PI * irradiance * (1.0f / samples.size());
+	}
+
+	static Vector2 integrate_BRDF(float NdotV, float roughness, const std::vector<Vector3>& half_vectors)
+	{
+		// isotropic, any V with this n_dot_v will do
+		Vector3 V(0, sqrt(1.0 - NdotV * NdotV), NdotV);
+
+		float A = 0.0;
+		float B = 0.0;
+		for (const Vector3& H : half_vectors)
+		{
+			Vector3 L = (2.f * V.dotProduct(H) * H - V).normalizedCopy();
+
+			float NdotL = std::max(L.z, 0.f);
+			float NdotH = std::max(H.z, 0.f);
+			float VdotH = std::max(V.dotProduct(H), 0.f);
+
+			if (NdotL > 0.0)
+			{
+				float G = geometry_Smith(NdotV, NdotL, roughness);
+				float G_Vis = (G * VdotH) / (NdotH * NdotV);
+				float Fc = pow(1.0 - VdotH, 5.0);
+
+				A += (1.0 - Fc) * G_Vis;
+				B += Fc * G_Vis;
+			}
+		}
+		return Vector2(A, B) / float(half_vectors.size());
+	}
+
+	static std::vector<Vector3> GGX_samples(float roughness, int count)
+	{
+		std::vector<Vector3> half_vectors(count);
+		for (int i = 0; i < count; i++)
+			half_vectors[i] = importance_sample_GGX(hammersley2d(i, count), roughness);
+		return half_vectors;
+	}
+
+	/*
+	*  SH9 projection
+	*     L_lm = sum over texels of L * Y_lm * solid angle, then each band is scaled by the cosine
+	*     lobe's A_l / pi (1, 2/3, 1/4) and each coefficient by its basis constant
+	*/
+	static const float SH9_BASIS[9] = {
+		0.282095f,
+		0.488603f, 0.488603f, 0.488603f,
+		1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f
+	};
+	static const float SH9_BAND_SCALE[9] = { 1.f, 2.f / 3.f, 2.f / 3.f, 2.f / 3.f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+
+	// the basis functions without their constants, in ibl_sh9::irradiance order
+	static void sh9_terms(const Vector3& n, float terms[9])
+	{
+		terms[0] = 1.f;
+		terms[1] = n.y;
+		terms[2] = n.z;
+		terms[3] = n.x;
+		terms[4] = n.x * n.y;
+		terms[5] = n.y * n.z;
+		terms[6] = 3.f * n.z * n.z - 1.f;
+		terms[7] = n.x * n.z;
+		terms[8] = n.x * n.x - n.y * n.y;
+	}
+
+	ibl_sh9 project_sh9(cubemap_t* environment, int threads)
+	{
+		const int ROW_BLOCK = 16;
+
+		// per (face, row block) sums, added up in task order so the result doesn't depend on scheduling
+		struct sh9_task
+		{
+			int face;
+			int row_begin, row_end;
+			double sums[9][3] = {};
+			double weight = 0.0;
+
+			sh9_task(int face, int row_begin, int row_end) : face(face), row_begin(row_begin), row_end(row_end) {}
+		};
+		std::vector<sh9_task> tasks;
+		for (int face = 0; face < 6; face++)
+			for (int row = 0; row < environment->faces[face]->height(); row += ROW_BLOCK)
+				tasks.emplace_back(face, row, std::min(row + ROW_BLOCK, environment->faces[face]->height()));
+
+		ThreadPool pool(threads > 0 ? threads - 1 : -1);
+		pool.parallel_for(0, (int)tasks.size(), [&](int index, int)
+		{
+			sh9_task& task = tasks[index];
+			const Texture2D& texture = *environment->faces[task.face];
+			int width = texture.width(), height = texture.height();
+
+			for (int y = task.row_begin; y < task.row_end; y++)
+			{
+				for (int x = 0; x < width; x++)
+				{
+					// texel center on a face at distance 0.5, solid angle 1 / (2 w h |d|^3)
+					Vector3 d = face_direction(task.face, (x + 0.5f) / width, (y + 0.5f) / height, 1.f);
+					float length = d.length();
+					double solid_angle = 1.0 / (2.0 * width * height * (double)length * length * length);
+
+					Vector4 color = texture.fetch(0, x, y);
+					float terms[9];
+					sh9_terms(d / length, terms);
+					for (int i = 0; i < 9; i++)
+					{
+						double w = terms[i] * solid_angle;
+						task.sums[i][0] += color.x * w;
+						task.sums[i][1] += color.y * w;
+						task.sums[i][2] += color.z * w;
+					}
+					task.weight += solid_angle;
+				}
+			}
+		});
+
+		double sums[9][3] = {};
+		double weight = 0.0;
+		for (const sh9_task& task : tasks)
+		{
+			for (int i = 0; i < 9; i++)
+				for (int c = 0; c < 3; c++)
+					sums[i][c] += task.sums[i][c];
+			weight += task.weight;
+		}
+
+		// the texel solid angles add up to 4 pi only approximately
+		ibl_sh9 sh9;
+		double normalize = weight > 0.0 ? 4.0 * Math_PI / weight : 0.0;
+		for (int i = 0; i < 9; i++)
+		{
+			double scale = normalize * SH9_BASIS[i] * SH9_BASIS[i] * SH9_BAND_SCALE[i];
+			sh9.coefficients[i] = Vector3((float)(sums[i][0] * scale), (float)(sums[i][1] * scale), (float)(sums[i][2] * scale));
+		}
+		return sh9;
+	}
+
+	ibl_sh9_error sh9_error(const ibl_sh9& sh9, const ibl_cubemap& irradiance)
+	{
+		ibl_sh9_error error;
+		double squares = 0.0, total = 0.0;
+		size_t count = 0;
+		for (int face = 0; face < 6; face++)
+		{
+			for (int y = 0; y < irradiance.size; y++)
+			{
+				for (int x = 0; x < irradiance.size; x++)
+				{
+					// the directions the map was baked for
+					Vector3 normal = face_direction(face, (float)x, (float)y, float(irradiance.size - 1)).normalizedCopy();
+					Vector3 expected = irradiance.texel(face, x, y);
+					Vector3 actual = sh9.irradiance(normal);
+					for (int c = 0; c < 3; c++)
+					{
+						float difference = std::fabs(actual[c] - expected[c]);
+						squares += (double)difference * difference;
+						total += expected[c];
+						error.max = std::max(error.max, difference);
+					}
+					count += 3;
+				}
+			}
+		}
+		if (count > 0)
+		{
+			error.rms = (float)std::sqrt(squares / count);
+			error.mean = (float)(total / count);
+		}
+		return error;
+	}
+
+	ibl_maps bake_ibl(cubemap_t* environment, const ibl_bake_options& options)
+	{
+		const int ROW_BLOCK = 8;
+
+		ibl_maps maps;
+		maps.sh9 = project_sh9(environment, options.threads);
+		maps.prefilter.resize(options.prefilter_levels);
+		std::vector<std::vector<Vector3> > prefilter_samples(options.prefilter_levels);
+		for (int level = 0; level < options.prefilter_levels; level++)
+		{
+			maps.prefilter[level].size = std::max(options.prefilter_size >> level, options.prefilter_min_size);
+			float roughness = options.prefilter_levels > 1 ? (float)level / (options.prefilter_levels - 1) : 0.f;
+			prefilter_samples[level] = GGX_samples(roughness, options.prefilter_samples);
+		}
+		maps.irradiance.size = options.irradiance_size;
+
+		std::vector<Vector4> irradiance_samples;
+		for (float phi = 0.0f; phi < 2.0 * Math_PI; phi += options.irradiance_step)
+		{
+			for (float theta = 0.0f; theta < 0.5 * Math_PI; theta += options.irradiance_step)
+				irradiance_samples.push_back(Vector4(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta), sin(theta) * cos(theta)));
+		}
+
+		maps.lut_size = options.lut_size;
+		maps.brdf_lut.resize((size_t)options.lut_size * options.lut_size);
+		std::vector<std::vector<Vector3> > lut_samples(options.lut_size);
+		Vector3 lut_tangent, lut_bitangent, lut_normal(0.f, 0.f, 1.f);
+		GGX_frame(lut_normal, lut_tangent, lut_bitangent);
+		for (int j = 0; j < options.lut_size; j++)
+		{
+			// around n = +z, in the same frame the prefilter uses for such a normal
+			lut_samples[j] = GGX_samples(j / (float)options.lut_size, options.lut_samples);
+			for (Vector3& H : lut_samples[j])
+				H = (lut_tangent * H.x + lut_bitangent * H.y + lut_normal * H.z).normalizedCopy();
+		}
+
+		/*
+		*  tasks : ROW_BLOCK rows of one face of one map (map null : rows of the LUT)
+		*     cost is the sample count, the queue is taken largest first
+		*/
+		struct bake_task
+		{
+			ibl_cubemap* map;
+			int level;				// prefilter level, -1 : irradiance
+			int face;
+			int row_begin, row_end;
+			double cost;
+		};
+		std::vector<bake_task> tasks;
+		auto add_tasks = [&tasks, ROW_BLOCK](ibl_cubemap* map, int level, int faces, int size, double texel_cost)
+		{
+			for (int face = 0; face < faces; face++)
+				for (int row = 0; row < size; row += ROW_BLOCK)
+				{
+					int row_end = std::min(row + ROW_BLOCK, size);
+					tasks.push_back({ map, level, face, row, row_end, texel_cost * (row_end - row) * size });
+				}
+		};
+		for (int level = 0; level < options.prefilter_levels; level++)
+		{
+			ibl_cubemap& map = maps.prefilter[level];
+			for (auto& face : map.faces)
+				face.resize((size_t)map.size * map.size);
+			add_tasks(&map, level, 6, map.size, options.prefilter_samples);
+		}
+		for (auto& face : maps.irradiance.faces)
+			face.resize((size_t)maps.irradiance.size * maps.irradiance.size);
+		add_tasks(&maps.irradiance, -1, 6, maps.irradiance.size, (double)irradiance_samples.size());
+		add_tasks(nullptr, 0, 1, maps.lut_size, options.lut_samples);
+
+		std::stable_sort(tasks.begin(), tasks.end(), [](const bake_task& a, const bake_task& b) { return a.cost > b.cost; });
+
+		ThreadPool pool(options.threads > 0 ? options.threads - 1 : -1);
+		pool.parallel_for(0, (int)tasks.size(), [&](int index, int)
+		{
+			const bake_task& task = tasks[index];
+			if (!task.map)
+			{
+				int size = maps.lut_size;
+				for (int j = task.row_begin; j < task.row_end; j++)
+					for (int i = 0; i < size; i++)
+						maps.brdf_lut[(size_t)j * size + i] = integrate_BRDF(i == 0 ? 0.002f : i / (float)size, j / (float)size, lut_samples[j]);
+				return;
+			}
+
+			int size = task.map->size;
+			std::vector<Vector3>& face = task.map->faces[task.face];
+			for (int y = task.row_begin; y < task.row_end; y++)
+			{
+				for (int x = 0; x < size; x++)
+				{
+					Vector3 normal = face_direction(task.face, x, y, float(size - 1)).normalizedCopy();
+					face[(size_t)y * size + x] = task.level < 0
+						? irradiance_texel(environment, normal, irradiance_samples)
+						: prefilter_texel(environment, normal, prefilter_samples[task.level]);
+				}
+			}
+		});
+
+		return maps;
+	}
+
+	uint64_t cubemap_hash(const cubemap_t* cubemap)
+	{
+		uint64_t hash = 0;
+		for (int face = 0; face < 6; face++)
+		{
+			uint64_t face_hash = cubemap->faces[face] ? cubemap->faces[face]->hash() : 0;
+			hash = hash_bytes(&face_hash, sizeof(face_hash), hash);
+		}
+		return hash;
+	}
+
+	/*
+	*  .oibl layout : header, then one section per prefilter level, the irradiance map and the LUT
+	*     the header is written last, a partially written file never has a valid magic
+	*/
+	static const char IBL_BUNDLE_MAGIC[4] = { 'O', 'I', 'B', 'L' };
+	static const uint32_t IBL_BUNDLE_VERSION = 3;
+	static const size_t IBL_BUNDLE_ALIGN = 16;
+	static const int IBL_BUNDLE_MAX_LEVELS = 16;
+	static const uint32_t IBL_BUNDLE_MAX_SIZE = 1 << 15;
+
+	/*
+	*  a cubemap section is its six faces back to back, the LUT section one size * size texture,
+	*  each in Texture2D's tiled RGB32F layout, so a loaded texture views the mapping as it is
+	*/
+	struct ibl_bundle_section
+	{
+		uint32_t size;
+		uint32_t reserved;
+		uint64_t offset;
+	};
+
+	struct ibl_bundle_header
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t source_hash;
+		// the options the maps were baked with
+		int32_t prefilter_size;
+		int32_t prefilter_min_size;
+		int32_t prefilter_levels;
+		int32_t prefilter_samples;
+		int32_t irradiance_size;
+		float irradiance_step;
+		int32_t lut_size;
+		int32_t lut_samples;
+		float sh9[9][3];
+		ibl_bundle_section prefilter[IBL_BUNDLE_MAX_LEVELS];
+		ibl_bundle_section irradiance;
+		ibl_bundle_section lut;
+	};
+
+	static void set_options(ibl_bundle_header& header, const ibl_bake_options& options)
+	{
+		header.prefilter_size = options.prefilter_size;
+		header.prefilter_min_size = options.prefilter_min_size;
+		header.prefilter_levels = options.prefilter_levels;
+		header.prefilter_samples = options.prefilter_samples;
+		header.irradiance_size = options.irradiance_size;
+		header.irradiance_step = options.irradiance_step;
+		header.lut_size = options.lut_size;
+		header.lut_samples = options.lut_samples;
+	}
+
+	static bool same_options(const ibl_bundle_header& header, const ibl_bake_options& options)
+	{
+		ibl_bundle_header expected;
+		set_options(expected, options);
+		return header.prefilter_size == expected.prefilter_size && header.prefilter_min_size == expected.prefilter_min_size
+			&& header.prefilter_levels == expected.prefilter_levels && header.prefilter_samples == expected.prefilter_samples
+			&& header.irradiance_size == expected.irradiance_size && header.irradiance_step == expected.irradiance_step
+			&& header.lut_size == expected.lut_size && header.lut_samples == expected.lut_samples;
+	}
+
+	static uint64_t align_offset(uint64_t offset)
+	{
+		return (offset + IBL_BUNDLE_ALIGN - 1) & ~(uint64_t)(IBL_BUNDLE_ALIGN - 1);
+	}
+
+	static uint64_t face_bytes(uint32_t size)
+	{
+		return Texture2D::tiled_size((int)size, (int)size, TextureFormat::RGB32F);
+	}
+
+	// (scale, bias, 0), as the LUT texture holds it
+	static std::vector<Vector3> lut_texels(const ibl_maps& maps)
+	{
+		std::vector<Vector3> lut(maps.brdf_lut.size());
+		for (size_t i = 0; i < lut.size(); i++)
+			lut[i] = Vector3(maps.brdf_lut[i].x, maps.brdf_lut[i].y, 0.f);
+		return lut;
+	}
+
+	ibl_environment::Ptr load_ibl_bundle(const std::string& path, uint64_t source_hash, const ibl_bake_options& options)
+	{
+		auto file = std::make_shared<MappedFile>();
+		if (!file->open(path) || file->size() < sizeof(ibl_bundle_header))
+			return nullptr;
+
+		ibl_bundle_header header;
+		memcpy(&header, file->data(), sizeof(header));
+		if (memcmp(header.magic, IBL_BUNDLE_MAGIC, 4) != 0 || header.version != IBL_BUNDLE_VERSION
+			|| header.source_hash != source_hash || !same_options(header, options)
+			|| header.prefilter_levels < 0 || header.prefilter_levels > IBL_BUNDLE_MAX_LEVELS)
+			return nullptr;
+
+		// every section must lie inside the file at an aligned offset
+		auto section_ok = [&file](const ibl_bundle_section& section, int textures)
+		{
+			uint64_t bytes = textures * face_bytes(section.size);
+			return section.size <= IBL_BUNDLE_MAX_SIZE && section.offset % IBL_BUNDLE_ALIGN == 0
+				&& section.offset <= file->size() && bytes <= file->size() - section.offset;
+		};
+		for (int level = 0; level < header.prefilter_levels; level++)
+			if (header.prefilter[level].size == 0 || !section_ok(header.prefilter[level], 6))
+				return nullptr;
+		if (!section_ok(header.irradiance, 6) || !section_ok(header.lut, 1))
+			return nullptr;
+
+		// the textures view the mapping, each holds on to it
+		auto view = [&file](const ibl_bundle_section& section, int index)
+		{
+			const uint8_t* texels = file->data() + section.offset + index * face_bytes(section.size);
+			return std::make_shared<Texture2D>((int)section.size, (int)section.size, TextureFormat::RGB32F, texels, file);
+		};
+		auto view_cubemap = [&view](const ibl_bundle_section& section)
+		{
+			cubemap_t cubemap;
+			for (int face = 0; face < 6; face++)
+				cubemap.faces[face] = view(section, face);
+			return cubemap;
+		};
+
+		auto environment = std::make_shared<ibl_environment>();
+		environment->bundle = file;
+		for (int level = 0; level < header.prefilter_levels; level++)
+			environment->prefilter.push_back(view_cubemap(header.prefilter[level]));
+		if (header.irradiance.size > 0)
+			environment->irradiance = view_cubemap(header.irradiance);
+		for (int i = 0; i < 9; i++)
+			environment->sh9.coefficients[i] = Vector3(header.sh9[i][0], header.sh9[i][1], header.sh9[i][2]);
+		if (header.lut.size > 0)
+			environment->brdf_lut = view(header.lut, 0);
+		return environment;
+	}
+
+	bool write_ibl_bundle(const std::string& path, uint64_t source_hash, const ibl_bake_options& options, const ibl_maps& maps)
+	{
+		if (maps.prefilter.size() > (size_t)IBL_BUNDLE_MAX_LEVELS)
+			return false;
+
+		ibl_bundle_header header = {};
+		memcpy(header.magic, IBL_BUNDLE_MAGIC, 4);
+		header.version = IBL_BUNDLE_VERSION;
+		header.source_hash = source_hash;
+		set_options(header, options);
+		header.prefilter_levels = (int32_t)maps.prefilter.size();
+		for (int i = 0; i < 9; i++)
+			for (int c = 0; c < 3; c++)
+				header.sh9[i][c] = maps.sh9.coefficients[i][c];
+
+		uint64_t offset = align_offset(sizeof(header));
+		for (size_t level = 0; level < maps.prefilter.size(); level++)
+		{
+			header.prefilter[level].size = (uint32_t)maps.prefilter[level].size;
+			header.prefilter[level].offset = offset;
+			offset = align_offset(offset + 6 * face_bytes(header.prefilter[level].size));
+		}
+		header.irradiance.size = (uint32_t)maps.irradiance.size;
+		header.irradiance.offset = offset;
+		offset = align_offset(offset + 6 * face_bytes(header.irradiance.size));
+		header.lut.size = (uint32_t)maps.lut_size;
+		header.lut.offset = offset;
+
+		// written under a temporary name and renamed, readers never see a partial file
+		std::string temp_path = path + ".tmp";
+		{
+			std::ofstream out(temp_path, std::ofstream::binary | std::ofstream::trunc);
+			if (out.fail())
+				return false;
+
+			ibl_bundle_header blank = {};
+			out.write((const char*)&blank, sizeof(blank));
+
+			auto pad_to = [&out](uint64_t offset)
+			{
+				static const char zeros[IBL_BUNDLE_ALIGN] = {};
+				uint64_t pos = (uint64_t)out.tellp();
+				out.write(zeros, (std::streamsize)(offset - pos));
+			};
+			// tiled by a level 0 only texture, exactly the bytes a loaded texture views
+			auto write_texture = [&out](int size, const Vector3* texels)
+			{
+				Texture2D tiled(size, size, texels, false);
+				out.write((const char*)tiled.level_data(), (std::streamsize)face_bytes((uint32_t)size));
+			};
+			auto write_cubemap = [&pad_to, &write_texture](const ibl_bundle_section& section, const ibl_cubemap& map)
+			{
+				pad_to(section.offset);
+				for (int face = 0; face < 6 && map.size > 0; face++)
+					write_texture(map.size, map.faces[face].data());
+			};
+			for (size_t level = 0; level < maps.prefilter.size(); level++)
+				write_cubemap(header.prefilter[level], maps.prefilter[level]);
+			write_cubemap(header.irradiance, maps.irradiance);
+			pad_to(header.lut.offset);
+			if (maps.lut_size > 0)
+				write_texture(maps.lut_size, lut_texels(maps).data());
+
+			out.seekp(0);
+			out.write((const char*)&header, sizeof(header));
+			if (!out.good())
+			{
+				out.close();
+				std::remove(temp_path.c_str());
+				return false;
+			}
+		}
+
+		std::error_code error;
+		std::filesystem::rename(temp_path, path, error);
+		if (error)
+		{
+			std::remove(temp_path.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	ibl_environment::Ptr load_or_bake_ibl(cubemap_t* environment, const std::string& path, const ibl_bake_options& options)
+	{
+		Timer timer(true);
+		uint64_t source_hash = cubemap_hash(environment);
+
+		if (ibl_environment::Ptr bundle = load_ibl_bundle(path, source_hash, options))
+		{
+			std::cerr << "# ibl bundle " << path << " " << timer.elapsed_ms() << " ms\n";
+			return bundle;
+		}
+
+		ibl_maps maps = bake_ibl(environment, options);
+		std::cerr << "# ibl baked in " << timer.elapsed_ms() << " ms\n";
+		if (maps.irradiance.size > 0)
+		{
+			ibl_sh9_error error = sh9_error(maps.sh9, maps.irradiance);
+			std::cerr << "# sh9 vs irradiance rms " << error.rms << " max " << error.max << " mean " << error.mean << '\n';
+		}
+
+		// the fresh bundle is mapped as a warm start maps it, the baked maps only serve when it can't be written
+		if (!write_ibl_bundle(path, source_hash, options, maps))
+			std::cerr << "ibl bundle write failed..." << path << '\n';
+		else if (ibl_environment::Ptr bundle = load_ibl_bundle(path, source_hash, options))
+			return bundle;
+		return make_ibl_environment(maps);
+	}
+
+	cubemap_t make_cubemap(const ibl_cubemap& map)
+	{
+		cubemap_t cubemap;
+		for (int face = 0; face < 6; face++)
+			cubemap.faces[face] = std::make_shared<Texture2D>(map.size, map.size, map.faces[face].data(), false);
+		return cubemap;
+	}
+
+	ibl_environment::Ptr make_ibl_environment(const ibl_maps& maps)
+	{
+		auto environment = std::make_shared<ibl_environment>();
+		for (const ibl_cubemap& level : maps.prefilter)
+			environment->prefilter.push_back(make_cubemap(level));
+		if (maps.irradiance.size > 0)
+			environment->irradiance = make_cubemap(maps.irradiance);
+		environment->sh9 = maps.sh9;
+		if (maps.lut_size > 0)
+			environment->brdf_lut = std::make_shared<Texture2D>(maps.lut_size, maps.lut_size, lut_texels(maps).data(), false);
+		return environment;
+	}
+
+	Vector3 ibl_environment::diffuse(const Vector3& n) const
+	{
+		if (irradiance.faces[0])
+			return cubemap_sample(n, &irradiance);
+		return sh9.irradiance(n);
+	}
+
+	// level i was baked for roughness i / (levels - 1)
+	Vector3 ibl_environment::specular(const Vector3& r, float roughness) const
+	{
+		if (prefilter.empty())
+			return Vector3(0.f, 0.f, 0.f);
+
+		float lod = Math::clamp(roughness, 0.f, 1.f) * (prefilter.size() - 1);
+		int level = (int)lod;
+		float t = lod - level;
+		Vector3 color = cubemap_sample(r, &prefilter[level]);
+		if (t > 0.f && level + 1 < (int)prefilter.size())
+			color = Vector3::lerp(color, cubemap_sample(r, &prefilter[level + 1]), t);
+		return color;
+	}
+
+	// texel (i, j) holds n_dot_v i / size and roughness j / size
+	Vector2 ibl_environment::brdf(float n_dot_v, float roughness) const
+	{
+		if (!brdf_lut)
+			return Vector2(1.f, 0.f);
+
+		float size = (float)brdf_lut->width();
+		float u = Math::clamp(n_dot_v * size + 0.5f, 0.5f, size - 0.5f) / size;
+		float v = Math::clamp(roughness * size + 0.5f, 0.5f, size - 0.5f) / size;
+		Vector4 scale_bias = brdf_lut->sample_bilinear(Vector2(u, v));
+		return Vector2(scale_bias.x, scale_bias.y);
+	}
+
+	bool write_ibl_maps(const ibl_maps& maps, const std::string& dir)
+	{
+		const char* faces[6] = { "px", "nx", "py", "ny", "pz", "nz" };
+
+		// face rows are stored bottom up, as cubemap_sample addresses them
+		for (size_t level = 0; level < maps.prefilter.size(); level++)
+		{
+			const ibl_cubemap& map = maps.prefilter[level];
+			for (int face = 0; face < 6; face++)
+				if (!write_hdr_file(dir + "/m" + std::to_string(level) + "_" + faces[face] + ".hdr", map.size, map.size, map.faces[face].data(), true))
+					return false;
+		}
+		for (int face = 0; face < 6 && maps.irradiance.size > 0; face++)
+			if (!write_hdr_file(dir + "/i_" + faces[face] + ".hdr", maps.irradiance.size, maps.irradiance.size, maps.irradiance.faces[face].data(), true))
+				return false;
+
+		std::vector<Vector3> lut(maps.brdf_lut.size());
+		for (size_t i = 0; i < lut.size(); i++)
+			lut[i] = Vector3(maps.brdf_lut[i].x, maps.brdf_lut[i].y, 0.f);
+		return write_hdr_file(dir + "/brdf_lut.hdr", maps.lut_size, maps.lut_size, lut.data(), true);
+	}
+} // OEngine
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "../../core/base/mapped_file.h"
+#include "../../core/math/math_headers.h"
+#include "../../resource/model.h"
+
+#include <string>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*
+*  image based lighting precompute : specular prefilter levels, diffuse irradiance and the BRDF LUT
+*     every face of every map is baked into its own buffer, the work is split into
+*     (map, face, row block) tasks that the workers of a ThreadPool pull from one shared queue,
+*     largest first, so a worker that finishes early keeps taking blocks until none are left
+*/
+
+namespace OEngine
+{
+	// one cubemap level, faces in cubemap_t order (+x, -x, +y, -y, +z, -z)
+	struct ibl_cubemap
+	{
+		int size = 0;
+		std::vector<Vector3> faces[6];		// linear color, texel (x, y) at [y * size + x]
+
+		const Vector3& texel(int face, int x, int y) const { return faces[face][y * size + x]; }
+	};
+
+	struct ibl_bake_options
+	{
+		int prefilter_size = 512;			// level 0, halved per level down to prefilter_min_size
+		int prefilter_min_size = 64;
+		int prefilter_levels = 10;			// roughness of level i : i / (prefilter_levels - 1)
+		int prefilter_samples = 1024;		// GGX importance samples per texel
+		int irradiance_size = 256;			// 0 : no irradiance map, diffuse comes from the SH9 projection
+		float irradiance_step = 0.025f;		// hemisphere integration step, radians
+		int lut_size = 256;
+		int lut_samples = 1024;
+		int threads = 0;					// <= 0 : every hardware thread
+	};
+
+	/*
+	*  diffuse irradiance as spherical harmonics, bands 0 - 2 (9 RGB coefficients)
+	*     the cosine lobe convolution and the basis constants are folded into the coefficients,
+	*     so an evaluation is a few multiply-adds of the normal's components
+	*/
+	struct ibl_sh9
+	{
+		Vector3 coefficients[9];
+
+		// same quantity as the irradiance map (irradiance / pi), n normalized
+		Vector3 irradiance(const Vector3& n) const
+		{
+			const Vector3* c = coefficients;
+			return c[0] + c[1] * n.y + c[2] * n.z + c[3] * n.x
+				+ c[4] * (n.x * n.y) + c[5] * (n.y * n.z) + c[6] * (3.f * n.z * n.z - 1.f)
+				+ c[7] * (n.x * n.z) + c[8] * (n.x * n.x - n.y * n.y);
+		}
+	};
+
+	// SH9 against the irradiance map, over the map's texels, per color channel
+	struct ibl_sh9_error
+	{
+		float rms = 0.f;
+		float max = 0.f;
+		float mean = 0.f;			// of the map, rms / mean is the relative error
+	};
+
+	struct ibl_maps
+	{
+		std::vector<ibl_cubemap> prefilter;	// one per roughness level
+		ibl_cubemap irradiance;				// size 0 when not baked
+		ibl_sh9 sh9;
+		int lut_size = 0;
+		std::vector<Vector2> brdf_lut;		// (scale, bias) of F0, [roughness * lut_size + n_dot_v]
+	};
+
+	ibl_maps bake_ibl(cubemap_t* environment, const ibl_bake_options& options = ibl_bake_options());
+
+	// one pass over the environment's texels, each weighted by its solid angle
+	ibl_sh9 project_sh9(cubemap_t* environment, int threads = 0);
+	ibl_sh9_error sh9_error(const ibl_sh9& sh9, const ibl_cubemap& irradiance);
+
+	// of the six faces' texels, identifies the environment a bundle was baked from
+	uint64_t cubemap_hash(const cubemap_t* cubemap);
+
+	// RGB32F faces sampled by cubemap_sample, texels are copied as they are, level 0 only
+	cubemap_t make_cubemap(const ibl_cubemap& map);
+
+	/*
+	*  runtime form of the baked maps, what PBRShader samples at shade time
+	*     diffuse    : the irradiance map when it was baked, else the SH9 projection
+	*     specular   : the two prefilter levels around the roughness, blended
+	*     brdf       : one bilinear fetch of the LUT, clamped to its texel centers (no wrap)
+	*/
+	struct ibl_environment
+	{
+		typedef std::shared_ptr<ibl_environment> Ptr;
+
+		std::vector<cubemap_t> prefilter;
+		cubemap_t irradiance;				// faces null when diffuse comes from sh9
+		ibl_sh9 sh9;
+		Texture2D::Ptr brdf_lut;			// (scale, bias, 0), u : n_dot_v, v : roughness
+		std::shared_ptr<MappedFile> bundle;	// the .oibl the textures view, null when built from ibl_maps
+
+		Vector3 diffuse(const Vector3& n) const;
+		Vector3 specular(const Vector3& r, float roughness) const;
+		Vector2 brdf(float n_dot_v, float roughness) const;
+	};
+
+	ibl_environment::Ptr make_ibl_environment(const ibl_maps& maps);
+
+	/*
+	*  packed bundle : every map of one environment in a single versioned file
+	*     header (source hash, bake options, SH9), then each cubemap's six faces and the LUT, every
+	*     section 16 byte aligned, texels stored in Texture2D's tiled RGB32F layout
+	*     a bundle only loads for the same source hash and options (threads aside), null otherwise,
+	*     the loaded textures view the mapped file, nothing is copied or tiled again
+	*/
+	ibl_environment::Ptr load_ibl_bundle(const std::string& path, uint64_t source_hash, const ibl_bake_options& options);
+	bool write_ibl_bundle(const std::string& path, uint64_t source_hash, const ibl_bake_options& options, const ibl_maps& maps);
+
+	// the bundle at path when it matches, else a fresh bake that replaces it (logging sh9_error when the irradiance map is baked)
+	ibl_environment::Ptr load_or_bake_ibl(cubemap_t* environment, const std::string& path, const ibl_bake_options& options = ibl_bake_options());
+
+	/*
+	*  one Radiance file per face, "m<level>_<face>.hdr" and "i_<face>.hdr" if baked (face : px nx py ny pz nz),
+	*  and "brdf_lut.hdr" (scale, bias, 0), false when a file can't be written
+	*     level 0 is named as cmgen names it, so the directory also loads as a skybox
+	*/
+	bool write_ibl_maps(const ibl_maps& maps, const std::string& dir);
+} // OEngine
@@ -0,0 +1,223 @@
+#include "raster_simd.h"
+#include "rasterizer.h"
+
+#ifdef OENGINE_X86
+#include <immintrin.h>
+#endif
+
+namespace OEngine
+{
+	/*
+	*  edge values stay below 2^48 (see Rasterizer::MAX_WINDOW_COORD), so they are converted
+	*  to double exactly by adding them to the bits of 2^52 + 2^51 and subtracting that double
+	*/
+	static const int64_t DOUBLE_MAGIC_BITS = 0x4338000000000000LL;
+	static const double DOUBLE_MAGIC = 6755399441055744.0;
+
+	static int raster_row_scalar(const raster_triangle& tri, const int64_t* e, int lane_mask, const float* depth, raster_row& out)
+	{
+		int hits = 0;
+		for (int i = 0; i < RASTER_BLOCK; i++)
+		{
+			if (!(lane_mask & (1 << i)))
+				continue;
+
+			int64_t e0 = e[0] + i * (tri.edge_a[0] << Rasterizer::SUBPIXEL_BITS);
+			int64_t e1 = e[1] + i * (tri.edge_a[1] << Rasterizer::SUBPIXEL_BITS);
+			int64_t e2 = e[2] + i * (tri.edge_a[2] << Rasterizer::SUBPIXEL_BITS);
+			if ((e0 | e1 | e2) < 0)
+				continue;
+
+			float b0 = (float)(double)(e0 - tri.edge_bias[0]) * tri.inv_area;
+			float b1 = (float)(double)(e1 - tri.edge_bias[1]) * tri.inv_area;
+			float b2 = (float)(double)(e2 - tri.edge_bias[2]) * tri.inv_area;
+
+			float Z = 1.f / (b0 * tri.inv_w[0] + b1 * tri.inv_w[1] + b2 * tri.inv_w[2]);
+			float zp = (b0 * tri.z_over_w[0] + b1 * tri.z_over_w[1] + b2 * tri.z_over_w[2]) * Z;
+
+			if (zp < depth[i])
+			{
+				out.b0[i] = b0;
+				out.b1[i] = b1;
+				out.b2[i] = b2;
+				out.z[i] = zp;
+				hits |= 1 << i;
+			}
+		}
+		return hits;
+	}
+
+#ifdef OENGINE_X86
+	/*
+	*  SSE2 : 4 pixels per pass, edge values are int64 so they take two registers per pass
+	*/
+	OENGINE_TARGET("sse2")
+	static __m128 edge_weights_sse2(int64_t e, int64_t step, int64_t bias, int first, __m128 inv_area)
+	{
+		const __m128i magic = _mm_set1_epi64x(DOUBLE_MAGIC_BITS);
+		const __m128d magic_d = _mm_set1_pd(DOUBLE_MAGIC);
+
+		int64_t v = e - bias + first * step;
+		__m128i lo = _mm_set_epi64x(v + step, v);
+		__m128i hi = _mm_set_epi64x(v + 3 * step, v + 2 * step);
+		__m128d dlo = _mm_sub_pd(_mm_castsi128_pd(_mm_add_epi64(lo, magic)), magic_d);
+		__m128d dhi = _mm_sub_pd(_mm_castsi128_pd(_mm_add_epi64(hi, magic)), magic_d);
+		__m128 w = _mm_movelh_ps(_mm_cvtpd_ps(dlo), _mm_cvtpd_ps(dhi));
+		return _mm_mul_ps(w, inv_area);
+	}
+
+	OENGINE_TARGET("sse2")
+	static int coverage_sse2(const raster_triangle& tri, const int64_t* e, int first)
+	{
+		__m128i lo = _mm_setzero_si128();
+		__m128i hi = _mm_setzero_si128();
+		for (int k = 0; k < 3; k++)
+		{
+			int64_t step = tri.edge_a[k] << Rasterizer::SUBPIXEL_BITS;
+			int64_t v = e[k] + first * step;
+			lo = _mm_or_si128(lo, _mm_set_epi64x(v + step, v));
+			hi = _mm_or_si128(hi, _mm_set_epi64x(v + 3 * step, v + 2 * step));
+		}
+		// sign bit set : outside of at least one edge
+		int outside = _mm_movemask_pd(_mm_castsi128_pd(lo)) | (_mm_movemask_pd(_mm_castsi128_pd(hi)) << 2);
+		return ~outside & 0xF;
+	}
+
+	OENGINE_TARGET("sse2")
+	static int raster_row_sse2(const raster_triangle& tri, const int64_t* e, int lane_mask, const float* depth, raster_row& out)
+	{
+		const __m128 inv_area = _mm_set1_ps(tri.inv_area);
+		int hits = 0;
+
+		for (int first = 0; first < RASTER_BLOCK; first += 4)
+		{
+			int lanes = (lane_mask >> first) & 0xF;
+			if (!lanes)
+				continue;
+
+			int covered = coverage_sse2(tri, e, first) & lanes;
+			if (!covered)
+				continue;
+
+			__m128 b0 = edge_weights_sse2(e[0], tri.edge_a[0] << Rasterizer::SUBPIXEL_BITS, tri.edge_bias[0], first, inv_area);
+			__m128 b1 = edge_weights_sse2(e[1], tri.edge_a[1] << Rasterizer::SUBPIXEL_BITS, tri.edge_bias[1], first, inv_area);
+			__m128 b2 = edge_weights_sse2(e[2], tri.edge_a[2] << Rasterizer::SUBPIXEL_BITS, tri.edge_bias[2], first, inv_area);
+
+			__m128 inv_z = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(b0, _mm_set1_ps(tri.inv_w[0])),
+				_mm_mul_ps(b1, _mm_set1_ps(tri.inv_w[1]))),
+				_mm_mul_ps(b2, _mm_set1_ps(tri.inv_w[2])));
+			__m128 zw = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(b0, _mm_set1_ps(tri.z_over_w[0])),
+				_mm_mul_ps(b1, _mm_set1_ps(tri.z_over_w[1]))),
+				_mm_mul_ps(b2, _mm_set1_ps(tri.z_over_w[2])));
+			__m128 zp = _mm_mul_ps(zw, _mm_div_ps(_mm_set1_ps(1.f), inv_z));
+
+			// lanes past the rect may be past the end of the buffer
+			__m128 old_z;
+			if (lanes == 0xF)
+				old_z = _mm_loadu_ps(depth + first);
+			else
+			{
+				float tmp[4];
+				for (int i = 0; i < 4; i++)
+					tmp[i] = (lanes & (1 << i)) ? depth[first + i] : 0.f;
+				old_z = _mm_loadu_ps(tmp);
+			}
+
+			int pass = _mm_movemask_ps(_mm_cmplt_ps(zp, old_z)) & covered;
+			if (!pass)
+				continue;
+
+			_mm_storeu_ps(out.b0 + first, b0);
+			_mm_storeu_ps(out.b1 + first, b1);
+			_mm_storeu_ps(out.b2 + first, b2);
+			_mm_storeu_ps(out.z + first, zp);
+			hits |= pass << first;
+		}
+		return hits;
+	}
+
+	/*
+	*  AVX2 : the whole row in one pass, two int64 registers per edge
+	*/
+	OENGINE_TARGET("avx2")
+	static __m256 edge_weights_avx2(__m256i lo, __m256i hi, __m256 inv_area)
+	{
+		const __m256i magic = _mm256_set1_epi64x(DOUBLE_MAGIC_BITS);
+		const __m256d magic_d = _mm256_set1_pd(DOUBLE_MAGIC);
+
+		__m256d dlo = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(lo, magic)), magic_d);
+		__m256d dhi = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(hi, magic)), magic_d);
+		__m256 w = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(dlo)), _mm256_cvtpd_ps(dhi), 1);
+		return _mm256_mul_ps(w, inv_area);
+	}
+
+	OENGINE_TARGET("avx2")
+	static int raster_row_avx2(const raster_triangle& tri, const int64_t* e, int lane_mask, const float* depth, raster_row& out)
+	{
+		__m256i lo[3], hi[3];
+		__m256i cover = _mm256_setzero_si256();
+		__m256i cover_hi = _mm256_setzero_si256();
+		for (int k = 0; k < 3; k++)
+		{
+			int64_t step = tri.edge_a[k] << Rasterizer::SUBPIXEL_BITS;
+			lo[k] = _mm256_set_epi64x(e[k] + 3 * step, e[k] + 2 * step, e[k] + step, e[k]);
+			hi[k] = _mm256_add_epi64(lo[k], _mm256_set1_epi64x(4 * step));
+			cover = _mm256_or_si256(cover, lo[k]);
+			cover_hi = _mm256_or_si256(cover_hi, hi[k]);
+		}
+
+		int outside = _mm256_movemask_pd(_mm256_castsi256_pd(cover)) | (_mm256_movemask_pd(_mm256_castsi256_pd(cover_hi)) << 4);
+		int covered = ~outside & lane_mask;
+		if (!covered)
+			return 0;
+
+		const __m256 inv_area = _mm256_set1_ps(tri.inv_area);
+		__m256 b[3];
+		for (int k = 0; k < 3; k++)
+		{
+			__m256i bias = _mm256_set1_epi64x(tri.edge_bias[k]);
+			b[k] = edge_weights_avx2(_mm256_sub_epi64(lo[k], bias), _mm256_sub_epi64(hi[k], bias), inv_area);
+		}
+
+		__m256 inv_z = _mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(b[0], _mm256_set1_ps(tri.inv_w[0])),
+			_mm256_mul_ps(b[1], _mm256_set1_ps(tri.inv_w[1]))),
+			_mm256_mul_ps(b[2], _mm256_set1_ps(tri.inv_w[2])));
+		__m256 zw = _mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(b[0], _mm256_set1_ps(tri.z_over_w[0])),
+			_mm256_mul_ps(b[1], _mm256_set1_ps(tri.z_over_w[1]))),
+			_mm256_mul_ps(b[2], _mm256_set1_ps(tri.z_over_w[2])));
+		__m256 zp = _mm256_mul_ps(zw, _mm256_div_ps(_mm256_set1_ps(1.f), inv_z));
+
+		// masked load, lanes past the rect may be past the end of the buffer
+		const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+		__m256i load_mask = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(lane_mask), lane_bits), lane_bits);
+		__m256 old_z = _mm256_maskload_ps(depth, load_mask);
+
+		int hits = _mm256_movemask_ps(_mm256_cmp_ps(zp, old_z, _CMP_LT_OQ)) & covered;
+		if (!hits)
+			return 0;
+
+		_mm256_storeu_ps(out.b0, b[0]);
+		_mm256_storeu_ps(out.b1, b[1]);
+		_mm256_storeu_ps(out.b2, b[2]);
+		_mm256_storeu_ps(out.z, zp);
+		return hits;
+	}
+#endif
+
+	raster_row_fn get_raster_row_fn(SimdLevel level)
+	{
+		SimdLevel supported = cpu_simd_level();
+		if ((int)level > (int)supported)
+			level = supported;
+
+#ifdef OENGINE_X86
+		if (level == SimdLevel::AVX2) return raster_row_avx2;
+		if (level == SimdLevel::SSE2) return raster_row_sse2;
+#endif
+		return raster_row_scalar;
+	}
+} // OEngine
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "../../core/base/cpu.h"
+
+#include <cstdint>
+
+/*
+*  coverage, barycentrics and depth test for one row of a RASTER_BLOCK x RASTER_BLOCK block
+*     e			: biased edge values at the first pixel of the row
+*     lane_mask : pixels of the row inside the rect being rasterized, only these lanes of depth are read
+*     depth		: depth buffer at the first pixel of the row
+*     returns a bit per pixel that is covered and passes the depth test, its weights and depth are in out
+*  every level does the same float operations in the same order, so they write identical pixels
+*/
+
+namespace OEngine
+{
+	struct raster_triangle;
+
+	static const int RASTER_BLOCK = 8;
+
+	struct raster_row
+	{
+		float b0[RASTER_BLOCK];
+		float b1[RASTER_BLOCK];
+		float b2[RASTER_BLOCK];
+		float z[RASTER_BLOCK];
+	};
+
+	typedef int (*raster_row_fn)(const raster_triangle& tri, const int64_t* e, int lane_mask, const float* depth, raster_row& out);
+
+	// falls back to the highest level below the requested one that the cpu supports
+	raster_row_fn get_raster_row_fn(SimdLevel level);
+} // OEngine
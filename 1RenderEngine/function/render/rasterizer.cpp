@@ -1,13 +1,35 @@
 #include "./rasterizer.h"
 #include "../../core/math/math_headers.h"
 
-#include <opencv2/opencv.hpp>
 #include <math.h>
 #include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
 #include <tuple>
 
 namespace OEngine
 {
+	// adds the time since the previous lap to a stage counter, does nothing when profiling is off
+	struct stage_clock
+	{
+		bool enabled;
+		std::chrono::steady_clock::time_point last;
+
+		explicit stage_clock(bool on) : enabled(on)
+		{
+			if (enabled) last = std::chrono::steady_clock::now();
+		}
+
+		void lap(uint64_t& total_ns)
+		{
+			if (!enabled) return;
+			auto now = std::chrono::steady_clock::now();
+			total_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+			last = now;
+		}
+	};
+
 	void Rasterizer::draw_line(Vector3 begin, Vector3 end)
 	{
 		auto x1 = begin.x;
@@ -130,19 +152,6 @@ namespace OEngine
 		return (a * b >= 0) && (a * c >= 0) && (b * c >= 0);
 	}
 
-	static bool insideTriangle(int x, int y, const Vector3* _v)
-	{
-		Vector2 PA = Vector2{ x - _v[0].x, y - _v[0].y };
-		Vector2 PB = Vector2{ x - _v[1].x, y - _v[1].y };
-		Vector2 PC = Vector2{ x - _v[2].x, y - _v[2].y };
-
-		float a = PA.crossProduct(PB);
-		float b = PB.crossProduct(PC);
-		float c = PC.crossProduct(PA);
-
-		return (a * b >= 0) && (a * c >= 0) && (b * c >= 0);
-	}
-
 	static std::tuple<float, float, float> computeBarycentric2D(float x, float y, const Vector4* v)
 	{
 		float c1 = (x * (v[1].y - v[2].y) + (v[2].x - v[1].x) * y + v[1].x * v[2].y - v[2].x * v[1].y) / (v[0].x * (v[1].y - v[2].y) + (v[2].x - v[1].x) * v[0].y + v[1].x * v[2].y - v[2].x * v[1].y);
@@ -151,14 +160,6 @@ namespace OEngine
 		return { c1, c2, c3 };
 	}
 
-	static std::tuple<float, float, float> computeBarycentric2D(float x, float y, const Vector3* v)
-	{
-		float c1 = (x * (v[1].y - v[2].y) + (v[2].x - v[1].x) * y + v[1].x * v[2].y - v[2].x * v[1].y) / (v[0].x * (v[1].y - v[2].y) + (v[2].x - v[1].x) * v[0].y + v[1].x * v[2].y - v[2].x * v[1].y);
-		float c2 = (x * (v[2].y - v[0].y) + (v[0].x - v[2].x) * y + v[2].x * v[0].y - v[0].x * v[2].y) / (v[1].x * (v[2].y - v[0].y) + (v[0].x - v[2].x) * v[1].y + v[2].x * v[0].y - v[0].x * v[2].y);
-		float c3 = (x * (v[0].y - v[1].y) + (v[1].x - v[0].x) * y + v[0].x * v[1].y - v[1].x * v[0].y) / (v[2].x * (v[0].y - v[1].y) + (v[1].x - v[0].x) * v[2].y + v[0].x * v[1].y - v[1].x * v[0].y);
-		return { c1, c2, c3 };
-	}
-
 	void Rasterizer::draw(std::vector<Triangle*>& TriangleList)
 	{
 		float f1 = (50 - 0.1) / 2.0;
@@ -229,6 +230,46 @@ namespace OEngine
 	}
 
 
+	/*
+	*  model bounds against the frustum of mvp, planes from Math::getFrustumPlanes
+	*     getFrustumPlanes reads the matrix as row vector * matrix, so it gets the transpose,
+	*     and clip w is negative in front of the camera here : inside is where every plane is <= 0
+	*     conservative, a box is only rejected when all its corners are outside one plane
+	*/
+	static bool outside_planes(const std::vector<Vector4>& planes, const Vector3& bounds_min, const Vector3& bounds_max)
+	{
+		for (const Vector4& plane : planes)
+		{
+			// corner the furthest along the inward normal (-plane)
+			Vector3 corner(plane.x < 0 ? bounds_max.x : bounds_min.x,
+				plane.y < 0 ? bounds_max.y : bounds_min.y,
+				plane.z < 0 ? bounds_max.z : bounds_min.z);
+			if (plane.x * corner.x + plane.y * corner.y + plane.z * corner.z + plane.w > 0)
+				return true;
+		}
+		return false;
+	}
+
+	// leaves the planes of mvp in planes for further tests
+	static bool outside_frustum(const Matrix4x4& mvp, const Vector3& bounds_min, const Vector3& bounds_max, std::vector<Vector4>& planes)
+	{
+		Math::getFrustumPlanes(planes, mvp.tranpose());
+		return outside_planes(planes, bounds_min, bounds_max);
+	}
+
+	/*
+	*  object space eye of mvp : the point projected to x = y = w = 0
+	*     false for a parallel projection, whose eye is at infinity
+	*/
+	static bool object_space_eye(const Matrix4x4& mvp, Vector3& eye)
+	{
+		Vector4 e = mvp.inverse() * Vector4(0.f, 0.f, 1.f, 0.f);
+		if (std::fabs(e.w) < Float_EPSILON)
+			return false;
+		eye = Vector3(e.x, e.y, e.z) / e.w;
+		return true;
+	}
+
 	void Rasterizer::draw(Model::Ptr model, ShaderProgram::Ptr shader)
 	{
 		float f1 = (50 - 0.1) / 2.0;
@@ -244,26 +285,591 @@ namespace OEngine
 		*		4. βü  ֮ǰ
 		*		5. ǹդ   
 		*/
-		for (int i = 0; i < model->nfaces(); i++)
+		begin_draw(shader);
+		worker_stats& draw_stats = m_worker_stats[m_pool->worker_id()];
+
+		// culling : the whole model, then its meshlets, before any vertex work
+		const uint8_t* meshlet_visible = nullptr;
+		const uint8_t* vertex_needed = nullptr;
+		int visible_faces = model->nfaces();
+		if (!model->is_skybox)
 		{
-			for (int j = 0; j < 3; j++)
+			std::vector<Vector4> planes(6);
+			if (outside_frustum(shader->m_mvp, model->bounds_min(), model->bounds_max(), planes))
 			{
-				shader->vertex_shader(i, j);
+				draw_stats.models_culled++;
+				m_shader = nullptr;
+				return;
+			}
+
+			m_meshlet_visible.resize(model->meshlets().size());
+			visible_faces = cull_meshlets(*model, shader->m_mvp, planes, m_meshlet_visible.data());
+			meshlet_visible = m_meshlet_visible.data();
+			if (visible_faces < model->nfaces())
+				vertex_needed = mark_vertices(*model);
+		}
+
+		// vertices : every welded vertex is shaded once, faces then gather their corners from the cache
+		shade_vertices(*model, *shader, vertex_needed);
+		draw_stats.corners += (uint64_t)visible_faces * 3;
+
+		// geometry : faces are processed in chunks, each chunk keeps its triangles in face order
+		int num_chunks = (model->nfaces() + FACE_CHUNK - 1) / FACE_CHUNK;
+		if ((int)m_chunk_triangles.size() < num_chunks)
+			m_chunk_triangles.resize(num_chunks);
+
+		run_stage(num_chunks, [this, &model, meshlet_visible](int chunk, int worker)
+		{
+			process_faces(*model, m_vertex_cache.data(), meshlet_visible, chunk, worker, m_chunk_triangles[chunk]);
+		});
+
+		rasterize_chunks(num_chunks);
+	}
+
+	/*
+	*  visibility of every meshlet : frustum against the planes of mvp, then the normal cone against
+	*  the eye (faces of a back facing cone all fail isBackFacing), returns the visible faces
+	*/
+	int Rasterizer::cull_meshlets(const Model& model, const Matrix4x4& mvp, const std::vector<Vector4>& planes, uint8_t* visible_out)
+	{
+		const std::vector<meshlet>& meshlets = model.meshlets();
+
+		Vector3 eye;
+		bool has_eye = object_space_eye(mvp, eye);
+
+		int visible_faces = 0;
+		uint64_t culled = 0;
+		for (size_t m = 0; m < meshlets.size(); m++)
+		{
+			const meshlet& cluster = meshlets[m];
+			bool visible = !outside_planes(planes, cluster.bounds_min, cluster.bounds_max);
+			if (visible && has_eye)
+			{
+				Vector3 to_center = cluster.center - eye;
+				visible = !(to_center.dotProduct(cluster.cone_axis) > cluster.cone_cutoff * to_center.length() + cluster.radius);
+			}
+
+			visible_out[m] = visible;
+			visible_faces += visible ? cluster.num_faces : 0;
+			culled += !visible;
+		}
+
+		m_worker_stats[m_pool->worker_id()].meshlets_culled += culled;
+		return visible_faces;
+	}
+
+	// vertices referenced by a meshlet left visible in m_meshlet_visible
+	const uint8_t* Rasterizer::mark_vertices(const Model& model)
+	{
+		m_vertex_needed.assign(model.nverts(), 0);
+
+		const std::vector<meshlet>& meshlets = model.meshlets();
+		const uint32_t* indices = model.indices().data();
+		for (size_t m = 0; m < meshlets.size(); m++)
+		{
+			if (!m_meshlet_visible[m])
+				continue;
+			uint32_t end = (meshlets[m].first_face + meshlets[m].num_faces) * 3;
+			for (uint32_t i = meshlets[m].first_face * 3; i < end; i++)
+				m_vertex_needed[indices[i]] = 1;
+		}
+		return m_vertex_needed.data();
+	}
+
+	void Rasterizer::draw_instanced(Model::Ptr model, ShaderProgram::Ptr shader, ArrayView<Matrix4x4> instances)
+	{
+		begin_draw(shader);
+		worker_stats& draw_stats = m_worker_stats[m_pool->worker_id()];
+
+		// per instance culling of the model and its meshlets, the surviving instances keep their order
+		std::vector<Vector4> planes(6);
+		size_t num_meshlets = model->meshlets().size();
+		m_instance_mvp.clear();
+		m_instance_model.clear();
+		for (const Matrix4x4& instance : instances)
+		{
+			Matrix4x4 mvp = shader->m_mvp * instance;
+			if (!model->is_skybox)
+			{
+				if (outside_frustum(mvp, model->bounds_min(), model->bounds_max(), planes))
+					continue;
+				if (m_meshlet_visible.size() < (m_instance_mvp.size() + 1) * num_meshlets)
+					m_meshlet_visible.resize((m_instance_mvp.size() + 1) * num_meshlets);
+				if (cull_meshlets(*model, mvp, planes, m_meshlet_visible.data() + m_instance_mvp.size() * num_meshlets) == 0)
+					continue;
 			}
+			m_instance_mvp.push_back(mvp);
+			m_instance_model.push_back(instance);
+		}
+		int num_instances = (int)m_instance_mvp.size();
+		draw_stats.instances += num_instances;
+		draw_stats.instances_culled += instances.size() - num_instances;
+		if (num_instances == 0)
+		{
+			m_shader = nullptr;
+			return;
+		}
+
+		// object space vertices, shaded once for all instances
+		shade_vertices(*model, *shader, nullptr);
+		draw_stats.corners += (uint64_t)model->nfaces() * 3 * num_instances;
+
+		// then moved into place per instance : clip from the instance's mvp, world and normal from its model matrix
+		int num_verts = model->nverts();
+		int vertex_chunks = (num_verts + VERTEX_CHUNK - 1) / VERTEX_CHUNK;
+		if (m_instance_vertices.size() < (size_t)num_verts * num_instances)
+			m_instance_vertices.resize((size_t)num_verts * num_instances);
+
+		m_instance_normal.resize(num_instances);
+		for (int i = 0; i < num_instances; i++)
+		{
+			Matrix3x3 normal_matrix;
+			m_instance_model[i].extract3x3Matrix(normal_matrix);
+			m_instance_normal[i] = normal_matrix.inverse().tranpose();
+		}
+
+		run_stage(num_instances * vertex_chunks, [this, num_verts, vertex_chunks](int item, int worker)
+		{
+			stage_clock clock(m_profiling);
+			int instance = item / vertex_chunks;
+			int chunk = item % vertex_chunks;
+			const Matrix4x4& mvp = m_instance_mvp[instance];
+			const Matrix4x4& world = m_instance_model[instance];
+			const Matrix3x3& normal_matrix = m_instance_normal[instance];
+			shaded_vertex* out = m_instance_vertices.data() + (size_t)instance * num_verts;
+
+			int vert_end = std::min((chunk + 1) * VERTEX_CHUNK, num_verts);
+			for (int v = chunk * VERTEX_CHUNK; v < vert_end; v++)
+			{
+				const shaded_vertex& src = m_vertex_cache[v];
+				out[v].clipPos	= mvp * Vector4(src.worldPos, 1.f);
+				out[v].worldPos	= world.tranformAffine(src.worldPos);
+				out[v].normal	= normal_matrix * src.normal;
+				out[v].uv		= src.uv;
+			}
+			clock.lap(m_worker_stats[worker].vertex_ns);
+		});
+
+		// geometry of every instance, then a single binning and raster pass over all of them
+		int face_chunks = (model->nfaces() + FACE_CHUNK - 1) / FACE_CHUNK;
+		int num_lists = num_instances * face_chunks;
+		if ((int)m_chunk_triangles.size() < num_lists)
+			m_chunk_triangles.resize(num_lists);
+
+		run_stage(num_lists, [this, &model, num_verts, num_meshlets, face_chunks](int item, int worker)
+		{
+			int instance = item / face_chunks;
+			const shaded_vertex* vertices = m_instance_vertices.data() + (size_t)instance * num_verts;
+			const uint8_t* meshlet_visible = model->is_skybox ? nullptr : m_meshlet_visible.data() + instance * num_meshlets;
+			process_faces(*model, vertices, meshlet_visible, item % face_chunks, worker, m_chunk_triangles[item]);
+		});
+
+		rasterize_chunks(num_lists);
+	}
+
+	// bit (1 << plane) for every clip plane the vertex is outside of
+	static int clip_outcode(const Vector4& vertex)
+	{
+		int code = 0;
+		for (int plane = W_PLANE; plane <= Z_FAR; plane++)
+			code |= !is_inside_plane((clip_plane)plane, vertex) << plane;
+		return code;
+	}
+
+	// x and y within guard_band times the viewport
+	static bool inside_guard_band(const Vector4& vertex, float guard_band)
+	{
+		float limit = -guard_band * vertex.w;
+		return std::fabs(vertex.x) <= limit && std::fabs(vertex.y) <= limit;
+	}
+
+	/*
+	*  homoClipping behind a trivial accept / reject test on the corners' outcodes
+	*     accepted and rejected triangles come out exactly as homoClipping would leave them
+	*     guard_band > 0 : triangles that are only outside the x / y planes but within guard_band
+	*                      times the viewport are accepted as well, the rasterizer's screen clamped
+	*                      bounding box and edge tests trim them instead
+	*/
+	static int clip_triangle(payload& pl, float guard_band, clip_result& result)
+	{
+		int code0 = clip_outcode(pl.in_clipPos[0]);
+		int code1 = clip_outcode(pl.in_clipPos[1]);
+		int code2 = clip_outcode(pl.in_clipPos[2]);
+
+		if (code0 & code1 & code2)
+		{
+			result = CLIP_REJECTED;
+			return 0;
+		}
+
+		const int XY_PLANES = (1 << X_RIGHT) | (1 << X_LEFT) | (1 << Y_TOP) | (1 << Y_BOTTOM);
+		int codes = code0 | code1 | code2;
+		bool accept = codes == 0;
+		if (!accept && guard_band > 0.f && (codes & ~XY_PLANES) == 0)
+			accept = inside_guard_band(pl.in_clipPos[0], guard_band) && inside_guard_band(pl.in_clipPos[1], guard_band)
+				&& inside_guard_band(pl.in_clipPos[2], guard_band);
+
+		if (accept)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				pl.out_clipPos[i]	= pl.in_clipPos[i];
+				pl.out_worldPos[i]	= pl.in_worldPos[i];
+				pl.out_normal[i]	= pl.in_normal[i];
+				pl.out_texCoords[i]	= pl.in_texCoords[i];
+			}
+			result = CLIP_ACCEPTED;
+			return 3;
+		}
+
+		result = CLIP_CLIPPED;
+		return homoClipping(pl);
+	}
+
+	void Rasterizer::begin_draw(const ShaderProgram::Ptr& shader)
+	{
+		m_shader = shader;
+
+		if (m_deferred)
+		{
+			m_materials.push_back(shader);
+			m_material = (int)m_materials.size() - 1;
+		}
+	}
+
+	void Rasterizer::run_stage(int count, const std::function<void(int, int)>& func)
+	{
+		if (m_tiled)
+			m_pool->parallel_for(0, count, func);
+		else
+			for (int i = 0; i < count; i++)
+				func(i, m_pool->worker_id());
+	}
+
+	void Rasterizer::shade_vertices(const Model& model, const ShaderProgram& shader, const uint8_t* needed)
+	{
+		int num_verts = model.nverts();
+		if ((int)m_vertex_cache.size() < num_verts)
+			m_vertex_cache.resize(num_verts);
+
+		run_stage((num_verts + VERTEX_CHUNK - 1) / VERTEX_CHUNK, [this, &shader, needed, num_verts](int chunk, int worker)
+		{
+			stage_clock clock(m_profiling);
+			uint64_t shaded = 0;
+			int vert_end = std::min((chunk + 1) * VERTEX_CHUNK, num_verts);
+			for (int v = chunk * VERTEX_CHUNK; v < vert_end; v++)
+			{
+				if (needed && !needed[v])
+					continue;
+				shader.vertex_shader(v, m_vertex_cache[v]);
+				shaded++;
+			}
+			clock.lap(m_worker_stats[worker].vertex_ns);
+			m_worker_stats[worker].vertices += shaded;
+		});
+	}
+
+	void Rasterizer::process_faces(const Model& model, const shaded_vertex* vertices, const uint8_t* meshlet_visible, int chunk, int worker,
+		std::vector<raster_triangle>& triangles)
+	{
+		static_assert(FACE_CHUNK % Model::MESHLET_FACES == 0, "face chunks hold whole meshlets");
+		const int CHUNK_MESHLETS = FACE_CHUNK / Model::MESHLET_FACES;
+
+		payload& pl = m_payloads[worker];
+		worker_stats& stats = m_worker_stats[worker];
+		triangles.clear();
+
+		stage_clock clock(m_profiling);
+		const std::vector<meshlet>& meshlets = model.meshlets();
+		int meshlet_end = std::min((chunk + 1) * CHUNK_MESHLETS, (int)meshlets.size());
+		const uint32_t* indices = model.indices().data();
+		for (int m = chunk * CHUNK_MESHLETS; m < meshlet_end; m++)
+		{
+			if (meshlet_visible && !meshlet_visible[m])
+				continue;
+
+			int face_end = meshlets[m].first_face + meshlets[m].num_faces;
+			for (int i = meshlets[m].first_face; i < face_end; i++)
+			{
+				for (int j = 0; j < 3; j++)
+				{
+					const shaded_vertex& vertex = vertices[indices[i * 3 + j]];
+					pl.in_clipPos[j]	= vertex.clipPos;
+					pl.in_worldPos[j]	= vertex.worldPos;
+					pl.in_normal[j]		= vertex.normal;
+					pl.in_texCoords[j]	= vertex.uv;
+				}
+				clock.lap(stats.vertex_ns);
+
+				// the skybox is clipped as well, the fixed point setup needs bounded window coordinates
+				clip_result clipped;
+				int num_vertex = clip_triangle(pl, m_guard_band ? m_guard_band_size : 0.f, clipped);
+				stats.clip_results[clipped]++;
+				clock.lap(stats.clip_ns);
+
+				for (int k = 0; k < num_vertex - 2; k++)
+				{
+					int ind0 = 0;
+					int ind1 = k + 1;
+					int ind2 = k + 2;
+
+					transform_attri(pl, ind0, ind1, ind2);
+					setup_triangle(pl, model.is_skybox, triangles);
+				}
+				clock.lap(stats.setup_ns);
+			}
+		}
+	}
+
+	// triangles of the first num_lists chunk lists, in list order
+	void Rasterizer::rasterize_chunks(int num_lists)
+	{
+		stage_clock clock(m_profiling);
+		worker_stats& stats = m_worker_stats[m_pool->worker_id()];
+
+		m_triangles.clear();
+		for (int list = 0; list < num_lists; list++)
+			m_triangles.insert(m_triangles.end(), m_chunk_triangles[list].begin(), m_chunk_triangles[list].end());
+
+		if (!m_tiled)
+		{
+			clock.lap(stats.setup_ns);
+
+			int worker = m_pool->worker_id();
+			for (const auto& tri : m_triangles)
+				rasterize_triangle(tri, worker, tri.min_x, tri.min_y, tri.max_x, tri.max_y);
+		}
+		else
+		{
+			bin_triangles();
+			clock.lap(stats.setup_ns);
+
+			m_pool->parallel_for(0, m_tiles_x * m_tiles_y, [this](int tile, int worker) { rasterize_tile(tile, worker); });
+		}
+
+		refresh_hiz();
+		m_shader = nullptr;
+	}
+
+	void Rasterizer::setup_triangle(const payload& pl, int is_skybox, std::vector<raster_triangle>& triangles)
+	{
+		raster_triangle tri;
+		Vector3 ndcPos[3];
+
+		for (int i = 0; i < 3; i++)
+		{
+			tri.clipCoord[i]	= pl.clipCoord_attri[i];
+			tri.worldCoord[i]	= pl.worldCoord_attri[i];
+			tri.normal[i]		= pl.normal_attri[i];
+			tri.uv[i]			= pl.uv_attri[i];
+		}
 
-			int num_vertex = 3;
-			// TODO
-			if (!model->is_skybox) num_vertex = homoClipping(shader->m_payload);
+		// ȥ
+		for (int i = 0; i < 3; i++)
+		{
+			ndcPos[i].x = tri.clipCoord[i].x / tri.clipCoord[i].w;
+			ndcPos[i].y = tri.clipCoord[i].y / tri.clipCoord[i].w;
+			ndcPos[i].z = tri.clipCoord[i].z / tri.clipCoord[i].w;
+		}
+
+		// Ӵ仯
+		for (int i = 0; i < 3; i++)
+		{
+			tri.windowPos[i].x = 0.5 * m_width * (ndcPos[i].x + 1.f);
+			tri.windowPos[i].y = 0.5 * m_height * (ndcPos[i].y + 1.f);
+			tri.windowPos[i].z = is_skybox ? 1000 : -(tri.clipCoord[i].w);
+		}
 
-			for (int k = 0; k < num_vertex - 2; k++)
+		if (!is_skybox)
+		{
+			if (isBackFacing(ndcPos))
+				return;
+		}
+
+		// snap to the subpixel grid, clipped triangles are (almost) inside the viewport
+		int64_t fx[3], fy[3];
+		for (int i = 0; i < 3; i++)
+		{
+			if (!(std::fabs(tri.windowPos[i].x) < MAX_WINDOW_COORD && std::fabs(tri.windowPos[i].y) < MAX_WINDOW_COORD))
+				return;
+			fx[i] = (int64_t)std::llround(tri.windowPos[i].x * SUBPIXEL_SCALE);
+			fy[i] = (int64_t)std::llround(tri.windowPos[i].y * SUBPIXEL_SCALE);
+		}
+
+		int64_t area = (fx[1] - fx[0]) * (fy[2] - fy[0]) - (fy[1] - fy[0]) * (fx[2] - fx[0]);
+		if (area == 0)
+			return;
+		// both windings are rasterized (the skybox is not culled), interior is where every edge >= 0
+		int64_t orient = area > 0 ? 1 : -1;
+		area *= orient;
+
+		/*
+		*  edge i is opposite to vertex i :  E_i(p) = A_i * p.x + B_i * p.y + C_i
+		*     E_i / area is the barycentric weight of vertex i
+		*     top-left rule : a sample exactly on an edge belongs to the triangle whose edge normal
+		*                     points to +x (or +y for horizontal edges), so shared edges are shaded once
+		*/
+		for (int i = 0; i < 3; i++)
+		{
+			int a = (i + 1) % 3;
+			int b = (i + 2) % 3;
+			tri.edge_a[i] = (fy[a] - fy[b]) * orient;
+			tri.edge_b[i] = (fx[b] - fx[a]) * orient;
+			tri.edge_c[i] = -(tri.edge_a[i] * fx[a] + tri.edge_b[i] * fy[a]);
+
+			bool top_left = tri.edge_a[i] > 0 || (tri.edge_a[i] == 0 && tri.edge_b[i] > 0);
+			tri.edge_bias[i] = top_left ? 0 : -1;
+		}
+		tri.inv_area = 1.f / (float)area;
+
+		// perspective correct depth : z = sum(b_i * z_i / w_i) / sum(b_i / w_i)
+		for (int i = 0; i < 3; i++)
+		{
+			tri.inv_w[i] = 1.f / tri.clipCoord[i].w;
+			tri.z_over_w[i] = tri.windowPos[i].z * tri.inv_w[i];
+		}
+
+		// pixel (x, y) is sampled at its center (x + 0.5, y + 0.5)
+		int64_t min_fx = std::min(fx[0], std::min(fx[1], fx[2]));
+		int64_t max_fx = std::max(fx[0], std::max(fx[1], fx[2]));
+		int64_t min_fy = std::min(fy[0], std::min(fy[1], fy[2]));
+		int64_t max_fy = std::max(fy[0], std::max(fy[1], fy[2]));
+
+		tri.min_x = (int)std::max<int64_t>(0, (min_fx - SUBPIXEL_HALF + SUBPIXEL_SCALE - 1) >> SUBPIXEL_BITS);
+		tri.min_y = (int)std::max<int64_t>(0, (min_fy - SUBPIXEL_HALF + SUBPIXEL_SCALE - 1) >> SUBPIXEL_BITS);
+		tri.max_x = (int)std::min<int64_t>(m_width - 1, (max_fx - SUBPIXEL_HALF) >> SUBPIXEL_BITS);
+		tri.max_y = (int)std::min<int64_t>(m_height - 1, (max_fy - SUBPIXEL_HALF) >> SUBPIXEL_BITS);
+
+		if (tri.min_x > tri.max_x || tri.min_y > tri.max_y)
+			return;
+
+		// perspective correct depth is a convex blend of the vertex depths, so it never goes below this
+		float min_z = std::min(tri.windowPos[0].z, std::min(tri.windowPos[1].z, tri.windowPos[2].z));
+		tri.min_z = min_z - std::fabs(min_z) * HIZ_EPSILON;
+
+		// hidden behind what the earlier draw calls left in the depth buffer
+		if (is_occluded(tri))
+			return;
+
+		// E_i at pixel center (X, Y) is A_i * 256 * X + B_i * 256 * Y + C_i, weighted by 1 / w_i
+		for (int p = 0; p < 3; p++)
+			tri.uv_plane[p][0] = tri.uv_plane[p][1] = tri.uv_plane[p][2] = 0.0;
+		for (int i = 0; i < 3; i++)
+		{
+			double weight[3] = { tri.inv_w[i] * (double)tri.uv[i].x, tri.inv_w[i] * (double)tri.uv[i].y, tri.inv_w[i] };
+			for (int p = 0; p < 3; p++)
 			{
-				int ind0 = 0;
-				int ind1 = k + 1;
-				int ind2 = k + 2;
+				tri.uv_plane[p][0] += weight[p] * (double)(tri.edge_a[i] * SUBPIXEL_SCALE);
+				tri.uv_plane[p][1] += weight[p] * (double)(tri.edge_b[i] * SUBPIXEL_SCALE);
+				tri.uv_plane[p][2] += weight[p] * (double)tri.edge_c[i];
+			}
+		}
+
+		triangles.push_back(tri);
+	}
+
+	bool Rasterizer::is_occluded(const raster_triangle& tri) const
+	{
+		for (int ty = tri.min_y / TILE_SIZE; ty <= tri.max_y / TILE_SIZE; ty++)
+			for (int tx = tri.min_x / TILE_SIZE; tx <= tri.max_x / TILE_SIZE; tx++)
+				if (tri.min_z < m_hiz_tile[ty * m_tiles_x + tx])
+					return false;
+		return true;
+	}
+
+	float Rasterizer::hiz_block(int block)
+	{
+		if (m_hiz_block_dirty[block])
+		{
+			int x0 = (block % m_blocks_x) * RASTER_BLOCK;
+			int y0 = (block / m_blocks_x) * RASTER_BLOCK;
+			int x1 = std::min(x0 + RASTER_BLOCK, m_width);
+			int y1 = std::min(y0 + RASTER_BLOCK, m_height);
 
-				if (!model->is_skybox) transform_attri(shader->m_payload, ind0, ind1, ind2);
-				rasterize_triangle(shader, model);
+			float farthest = -std::numeric_limits<float>::infinity();
+			for (int y = y0; y < y1; y++)
+			{
+				const float* depth = m_depth_buf.data() + get_index(0, y);
+				for (int x = x0; x < x1; x++)
+					farthest = std::max(farthest, depth[x]);
 			}
+
+			m_hiz_block[block] = farthest;
+			m_hiz_block_dirty[block] = 0;
+		}
+		return m_hiz_block[block];
+	}
+
+	float Rasterizer::hiz_tile(int tile)
+	{
+		if (m_hiz_tile_dirty[tile])
+		{
+			const int blocks_per_tile = TILE_SIZE / RASTER_BLOCK;
+			int bx0 = (tile % m_tiles_x) * blocks_per_tile;
+			int by0 = (tile / m_tiles_x) * blocks_per_tile;
+			int bx1 = std::min(bx0 + blocks_per_tile, m_blocks_x);
+			int by1 = std::min(by0 + blocks_per_tile, m_blocks_y);
+
+			float farthest = -std::numeric_limits<float>::infinity();
+			for (int by = by0; by < by1; by++)
+				for (int bx = bx0; bx < bx1; bx++)
+					farthest = std::max(farthest, hiz_block(by * m_blocks_x + bx));
+
+			m_hiz_tile[tile] = farthest;
+			m_hiz_tile_dirty[tile] = 0;
+		}
+		return m_hiz_tile[tile];
+	}
+
+	void Rasterizer::refresh_hiz()
+	{
+		// triangle setup of the next draw only reads the tile level, so it has to be current
+		int num_tiles = m_tiles_x * m_tiles_y;
+		if (m_tiled)
+			m_pool->parallel_for(0, num_tiles, [this](int tile, int) { hiz_tile(tile); });
+		else
+			for (int tile = 0; tile < num_tiles; tile++)
+				hiz_tile(tile);
+	}
+
+	void Rasterizer::reset_hiz()
+	{
+		std::fill(m_hiz_block.begin(), m_hiz_block.end(), std::numeric_limits<float>::infinity());
+		std::fill(m_hiz_block_dirty.begin(), m_hiz_block_dirty.end(), 0);
+		std::fill(m_hiz_tile.begin(), m_hiz_tile.end(), std::numeric_limits<float>::infinity());
+		std::fill(m_hiz_tile_dirty.begin(), m_hiz_tile_dirty.end(), 0);
+	}
+
+	void Rasterizer::bin_triangles()
+	{
+		for (auto& bin : m_bins)
+			bin.clear();
+
+		for (int i = 0; i < (int)m_triangles.size(); i++)
+		{
+			const raster_triangle& tri = m_triangles[i];
+			for (int ty = tri.min_y / TILE_SIZE; ty <= tri.max_y / TILE_SIZE; ty++)
+				for (int tx = tri.min_x / TILE_SIZE; tx <= tri.max_x / TILE_SIZE; tx++)
+					m_bins[ty * m_tiles_x + tx].push_back(i);
+		}
+	}
+
+	void Rasterizer::rasterize_tile(int tile, int worker)
+	{
+		int tile_x0 = (tile % m_tiles_x) * TILE_SIZE;
+		int tile_y0 = (tile / m_tiles_x) * TILE_SIZE;
+		int tile_x1 = std::min(tile_x0 + TILE_SIZE, m_width) - 1;
+		int tile_y1 = std::min(tile_y0 + TILE_SIZE, m_height) - 1;
+
+		for (int index : m_bins[tile])
+		{
+			const raster_triangle& tri = m_triangles[index];
+			if (tri.min_z >= hiz_tile(tile))
+				continue;
+
+			rasterize_triangle(tri, worker,
+				std::max(tri.min_x, tile_x0), std::max(tri.min_y, tile_y0),
+				std::min(tri.max_x, tile_x1), std::min(tri.max_y, tile_y1));
 		}
 	}
 
@@ -319,72 +925,219 @@ namespace OEngine
 		}
 	}
 
-	void Rasterizer::rasterize_triangle(ShaderProgram::Ptr shader, Model::Ptr model)
+	/*
+	*  uv derivatives of the 2x2 quad whose top-left pixel is (qx, qy) : (du/dx, dv/dx, du/dy, dv/dy)
+	*     forward differences along the quad's top row and left column, as a GPU would take them,
+	*     pixels of the quad outside the triangle extrapolate its uv plane like helper lanes
+	*/
+	static Vector4 quad_uv_deriv(const raster_triangle& tri, int qx, int qy)
 	{
-		Vector3 ndcPos[3];
-		Vector3 windowPos[3];
-		int is_skybox = model->is_skybox;
+		const double(*plane)[3] = tri.uv_plane;
+		double X = qx + 0.5, Y = qy + 0.5;
+
+		double u = plane[0][0] * X + plane[0][1] * Y + plane[0][2];
+		double v = plane[1][0] * X + plane[1][1] * Y + plane[1][2];
+		double d = plane[2][0] * X + plane[2][1] * Y + plane[2][2];
+		double dx = d + plane[2][0];
+		double dy = d + plane[2][1];
+		if (d == 0.0 || dx == 0.0 || dy == 0.0)
+			return Vector4(0.f);
+
+		double u00 = u / d, v00 = v / d;
+		double u10 = (u + plane[0][0]) / dx, v10 = (v + plane[1][0]) / dx;
+		double u01 = (u + plane[0][1]) / dy, v01 = (v + plane[1][1]) / dy;
+		return Vector4((float)(u10 - u00), (float)(v10 - v00), (float)(u01 - u00), (float)(v01 - v00));
+	}
+
+	void Rasterizer::rasterize_triangle(const raster_triangle& tri, int worker, int x0, int y0, int x1, int y1)
+	{
+		const ShaderProgram* shader = m_shader.get();
+		payload& pl = m_payloads[worker];
+		worker_stats& stats = m_worker_stats[worker];
+		stage_clock clock(m_profiling);
 
-		// ȥ
 		for (int i = 0; i < 3; i++)
 		{
-			ndcPos[i].x = shader->m_payload.clipCoord_attri[i].x / shader->m_payload.clipCoord_attri[i].w;
-			ndcPos[i].y = shader->m_payload.clipCoord_attri[i].y / shader->m_payload.clipCoord_attri[i].w;
-			ndcPos[i].z = shader->m_payload.clipCoord_attri[i].z / shader->m_payload.clipCoord_attri[i].w;
+			pl.clipCoord_attri[i]	= tri.clipCoord[i];
+			pl.worldCoord_attri[i]	= tri.worldCoord[i];
+			pl.normal_attri[i]		= tri.normal[i];
+			pl.uv_attri[i]			= tri.uv[i];
 		}
 
-		// Ӵ仯
+		// largest growth of each edge function across a block, a block is skipped when
+		// even its best corner is outside one of the edges
+		int64_t block_reach[3];
 		for (int i = 0; i < 3; i++)
 		{
-			windowPos[i].x = 0.5 * m_width * (ndcPos[i].x + 1.f);
-			windowPos[i].y = 0.5 * m_height * (ndcPos[i].y + 1.f);
-			windowPos[i].z = is_skybox ? 1000:-(shader->m_payload.clipCoord_attri[i].w);
+			block_reach[i] = (std::max<int64_t>(tri.edge_a[i], 0) + std::max<int64_t>(tri.edge_b[i], 0))
+				* ((int64_t)(RASTER_BLOCK - 1) << SUBPIXEL_BITS);
 		}
 
-		if (!is_skybox)
+		// blocks are aligned to the screen, so they never straddle a tile
+		int bx0 = x0 & ~(RASTER_BLOCK - 1);
+		int by0 = y0 & ~(RASTER_BLOCK - 1);
+		raster_row row;
+		// derivatives are shared by the 4 pixels of a quad, recomputed when the quad changes
+		int quad_x = -1, quad_y = -1;
+
+		for (int by = by0; by <= y1; by += RASTER_BLOCK)
 		{
-			if (isBackFacing(ndcPos))
-				return;
-		}
+			int row_y0 = std::max(y0, by);
+			int row_y1 = std::min(y1, by + RASTER_BLOCK - 1);
 
-		// դ
-		float xlhs = std::min(windowPos[0].x, std::min(windowPos[1].x, windowPos[2].x));
-		float xrhs = std::max(windowPos[0].x, std::max(windowPos[1].x, windowPos[2].x));
-		float ybot = std::min(windowPos[0].y, std::min(windowPos[1].y, windowPos[2].y));
-		float ycel = std::max(windowPos[0].y, std::max(windowPos[1].y, windowPos[2].y));
+			for (int bx = bx0; bx <= x1; bx += RASTER_BLOCK)
+			{
+				// edge values at the center of the block's first pixel
+				int64_t px = ((int64_t)bx << SUBPIXEL_BITS) + SUBPIXEL_HALF;
+				int64_t py = ((int64_t)by << SUBPIXEL_BITS) + SUBPIXEL_HALF;
 
-		// std::cout << xlhs << " -> " << xrhs << "----" << ybot << " -> " << ycel << '\n';
+				int64_t e[3];
+				bool outside = false;
+				for (int i = 0; i < 3; i++)
+				{
+					e[i] = tri.edge_a[i] * px + tri.edge_b[i] * py + tri.edge_c[i] + tri.edge_bias[i];
+					outside |= e[i] + block_reach[i] < 0;
+				}
+				if (outside)
+					continue;
 
-		for (int x = xlhs; x <= xrhs; x++)
-		{
-			for (int y = ybot; y <= ycel; y++)
-			{
-				int ind = get_index(x, y);
+				int block = (by / RASTER_BLOCK) * m_blocks_x + bx / RASTER_BLOCK;
+				if (tri.min_z >= hiz_block(block))
+					continue;
 
-				if (ind < 0 || ind >= m_depth_buf.size()) continue;
+				int lane_x0 = std::max(x0 - bx, 0);
+				int lane_x1 = std::min(x1 - bx, RASTER_BLOCK - 1);
+				int lane_mask = ((1 << (lane_x1 + 1)) - 1) & ~((1 << lane_x0) - 1);
 
-				if (insideTriangle(x, y, windowPos))
+				bool written = false;
+				for (int y = row_y0; y <= row_y1; y++)
 				{
-					// std::cout << "inside compute..." << '\n';
-					auto [alpha, gamma, beta] = computeBarycentric2D(x, y, windowPos);
-					float Z = 1.f / (alpha / shader->m_payload.clipCoord_attri[0].w + beta / shader->m_payload.clipCoord_attri[1].w + gamma / shader->m_payload.clipCoord_attri[2].w);
-					float zp = alpha * windowPos[0].z / shader->m_payload.clipCoord_attri[0].w
-						+ beta * windowPos[1].z / shader->m_payload.clipCoord_attri[1].w
-						+ gamma * windowPos[2].z / shader->m_payload.clipCoord_attri[2].w;
-					zp *= Z;
-					
-					if (zp < m_depth_buf[ind])
+					int64_t er[3];
+					for (int i = 0; i < 3; i++)
+						er[i] = e[i] + tri.edge_b[i] * ((int64_t)(y - by) << SUBPIXEL_BITS);
+
+					// weights of vertex 0, 1, 2 (shaders take them as alpha, gamma, beta)
+					int hits = m_raster_row(tri, er, lane_mask, m_depth_buf.data() + get_index(bx, y), row);
+					if (!hits)
+						continue;
+
+					written = true;
+					clock.lap(stats.raster_ns);
+
+					for (int i = 0; hits; i++, hits >>= 1)
 					{
-						m_depth_buf[ind] = zp;
+						if (!(hits & 1))
+							continue;
 
-						Vector3 color = shader->fragment_shader(alpha, gamma, beta);
+						int x = bx + i;
+						int ind = get_index(x, y);
+						m_depth_buf[ind] = row.z[i];
+						stats.written++;
+
+						if ((x & ~1) != quad_x || (y & ~1) != quad_y)
+						{
+							quad_x = x & ~1;
+							quad_y = y & ~1;
+							pl.uv_deriv = quad_uv_deriv(tri, quad_x, quad_y);
+						}
+
+						if (m_deferred)
+						{
+							gbuffer_texel& texel = m_gbuffer[ind];
+							texel.duv = pl.uv_deriv;
+							shader->surface(pl, row.b0[i], row.b1[i], row.b2[i], texel);
+							texel.material = m_material;
+							continue;
+						}
+
+						Vector3 color = shader->fragment_shader(pl, row.b0[i], row.b1[i], row.b2[i]);
+						stats.shaded++;
 
 						Vector3 pixel_color = color.clamp(color, Vector3(0, 0, 0), Vector3(255.f, 255.f, 255.f));
 						set_pixel(Vector2((int)x, (int)y), pixel_color);
 					}
+					clock.lap(stats.fragment_ns);
+				}
+
+				if (written)
+				{
+					m_hiz_block_dirty[block] = 1;
+					m_hiz_tile_dirty[(by / TILE_SIZE) * m_tiles_x + bx / TILE_SIZE] = 1;
 				}
 			}
 		}
+
+		clock.lap(stats.raster_ns);
+	}
+
+	void Rasterizer::set_deferred(bool deferred)
+	{
+		m_deferred = deferred;
+		if (m_deferred && m_gbuffer.empty())
+			m_gbuffer.resize(m_width * m_height);
+	}
+
+	void Rasterizer::resolve()
+	{
+		if (!m_deferred)
+			return;
+
+		auto resolve_row = [this](int y, int worker)
+		{
+			worker_stats& stats = m_worker_stats[worker];
+			stage_clock clock(m_profiling);
+
+			for (int x = 0; x < m_width; x++)
+			{
+				const gbuffer_texel& texel = m_gbuffer[get_index(x, y)];
+				if (texel.material < 0)
+					continue;
+
+				Vector3 color = m_materials[texel.material]->shade(texel);
+				stats.shaded++;
+
+				Vector3 pixel_color = color.clamp(color, Vector3(0, 0, 0), Vector3(255.f, 255.f, 255.f));
+				set_pixel(Vector2((int)x, (int)y), pixel_color);
+			}
+
+			clock.lap(stats.fragment_ns);
+		};
+
+		if (m_tiled)
+			m_pool->parallel_for(0, m_height, resolve_row);
+		else
+			for (int y = 0; y < m_height; y++)
+				resolve_row(y, m_pool->worker_id());
+	}
+
+	FrameStats Rasterizer::frame_stats() const
+	{
+		FrameStats stats;
+		for (const auto& worker : m_worker_stats)
+		{
+			stats.fragments_written += worker.written;
+			stats.fragments_shaded += worker.shaded;
+
+			stats.vertex_ms += worker.vertex_ns * 1e-6;
+			stats.clip_ms += worker.clip_ns * 1e-6;
+			stats.setup_ms += worker.setup_ns * 1e-6;
+			stats.raster_ms += worker.raster_ns * 1e-6;
+			stats.fragment_ms += worker.fragment_ns * 1e-6;
+
+			stats.vertices_shaded += worker.vertices;
+			stats.vertices_referenced += worker.corners;
+
+			stats.instances_drawn += worker.instances;
+			stats.instances_culled += worker.instances_culled;
+			stats.triangles_accepted += worker.clip_results[CLIP_ACCEPTED];
+			stats.triangles_rejected += worker.clip_results[CLIP_REJECTED];
+			stats.triangles_clipped += worker.clip_results[CLIP_CLIPPED];
+			stats.models_culled += worker.models_culled;
+			stats.meshlets_culled += worker.meshlets_culled;
+		}
+		for (float depth : m_depth_buf)
+			stats.pixels_covered += depth < std::numeric_limits<float>::infinity();
+		return stats;
 	}
 
 	void Rasterizer::set_model(const Matrix4x4& m)
@@ -407,17 +1160,50 @@ namespace OEngine
 		if ((buff & Buffers::Color) == Buffers::Color)
 		{
 			std::fill(m_frame_buf.begin(), m_frame_buf.end(), Vector3{ 0, 0, 0 });
+
+			// a new frame : drop the G-buffer contents and the counters
+			for (auto& texel : m_gbuffer)
+				texel.material = -1;
+			m_materials.clear();
+			std::fill(m_worker_stats.begin(), m_worker_stats.end(), worker_stats());
 		}
 		if ((buff & Buffers::Depth) == Buffers::Depth)
 		{
 			std::fill(m_depth_buf.begin(), m_depth_buf.end(), std::numeric_limits<float>::infinity());
+			reset_hiz();
 		}
 	}
 
-	Rasterizer::Rasterizer(int w, int h) : m_width(w), m_height(h)
+	Rasterizer::Rasterizer(int w, int h, int num_threads) : m_width(w), m_height(h)
 	{
+		// setup drops vertices at or beyond MAX_WINDOW_COORD, a larger frame would lose geometry
+		if (w <= 0 || h <= 0 || w >= MAX_WINDOW_COORD || h >= MAX_WINDOW_COORD)
+			throw std::invalid_argument("Rasterizer: unsupported frame size " + std::to_string(w) + "x" + std::to_string(h));
+
 		m_frame_buf.resize(w * h);
 		m_depth_buf.resize(w * h);
+
+		m_pool = std::make_shared<ThreadPool>(num_threads > 0 ? num_threads - 1 : -1);
+		m_payloads.resize(m_pool->size() + 1);
+		m_worker_stats.resize(m_pool->size() + 1);
+
+		// ndc g maps to window (1 + g) / 2 * size, the band reaches half way to MAX_WINDOW_COORD,
+		// frames wider than half of it get a band narrower than the viewport (the rest is clipped)
+		m_guard_band_size = std::max(0.f, MAX_WINDOW_COORD / std::max(w, h) - 1.f);
+
+		m_tiles_x = (w + TILE_SIZE - 1) / TILE_SIZE;
+		m_tiles_y = (h + TILE_SIZE - 1) / TILE_SIZE;
+		m_bins.resize(m_tiles_x * m_tiles_y);
+
+		m_blocks_x = (w + RASTER_BLOCK - 1) / RASTER_BLOCK;
+		m_blocks_y = (h + RASTER_BLOCK - 1) / RASTER_BLOCK;
+		m_hiz_block.resize(m_blocks_x * m_blocks_y);
+		m_hiz_block_dirty.resize(m_blocks_x * m_blocks_y);
+		m_hiz_tile.resize(m_tiles_x * m_tiles_y);
+		m_hiz_tile_dirty.resize(m_tiles_x * m_tiles_y);
+		reset_hiz();
+
+		m_raster_row = get_raster_row_fn(cpu_simd_level());
 	}
 
 	int Rasterizer::get_index(int x, int y)
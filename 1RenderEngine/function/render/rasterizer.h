@@ -1,10 +1,12 @@
 #pragma once
 
 #include "../../core/math/math_headers.h"
-#include "../../resource/texture.h"
+#include "../../core/base/thread_pool.h"
+#include "./raster_simd.h"
 #include "../../resource/model.h"
 #include "./shader.h"
 
+#include <cstdint>
 #include <optional>
 #include <functional>
 #include <memory>
@@ -27,14 +29,119 @@ namespace OEngine
 		return Buffers((int)a & (int)b);
 	}
 
+	/*
+	*  per frame counters, reset by clear(Buffers::Color)
+	*     shaded_per_pixel() is the shading overdraw : > 1 forward, exactly 1 deferred
+	*/
+	struct FrameStats
+	{
+		uint64_t fragments_written = 0;		// fragments that passed the depth test
+		uint64_t fragments_shaded = 0;		// fragment_shader / shade calls
+		uint64_t pixels_covered = 0;		// pixels with finite depth
+
+		float shaded_per_pixel() const { return pixels_covered ? (float)fragments_shaded / pixels_covered : 0.f; }
+
+		// cpu time of each stage summed over all workers, only measured with set_profiling(true)
+		double vertex_ms = 0;
+		double clip_ms = 0;
+		double setup_ms = 0;		// triangle setup, occlusion culling and binning
+		double raster_ms = 0;		// coverage and depth test
+		double fragment_ms = 0;		// fragment_shader, or surface + shade when deferred
+
+		// post-transform vertex cache : every welded vertex is shaded once per draw
+		uint64_t vertices_shaded = 0;		// vertex_shader calls
+		uint64_t vertices_referenced = 0;	// face corners, what a per-corner vertex stage would shade
+		float vertex_reuse() const { return vertices_shaded ? (float)vertices_referenced / vertices_shaded : 0.f; }
+
+		// draw_instanced
+		uint64_t instances_drawn = 0;
+		uint64_t instances_culled = 0;		// bounds entirely outside the frustum
+
+		// rejected before any vertex work, against the frustum and (meshlets) the back facing normal cone
+		uint64_t models_culled = 0;
+		uint64_t meshlets_culled = 0;
+
+		// triangles entering clipping, by outcome (see clip_result)
+		uint64_t triangles_accepted = 0;	// inside the frustum, or the guard band
+		uint64_t triangles_rejected = 0;	// outside one clip plane
+		uint64_t triangles_clipped = 0;		// took the full homoClipping path
+	};
+
+	/*
+	*  triangle after clipping and viewport transform
+	*     attributes are copied into the shader payload when one of its tiles is shaded
+	*     edge_*  : half-space edge functions in SUBPIXEL_BITS fixed point, edge i is opposite to vertex i
+	*     min/max : pixel bounding box, already clamped to the screen
+	*/
+	struct raster_triangle
+	{
+		Vector4 clipCoord[3];
+		Vector3 worldCoord[3];
+		Vector3 normal[3];
+		Vector2 uv[3];
+
+		Vector3 windowPos[3];
+
+		int64_t edge_a[3], edge_b[3], edge_c[3];
+		int64_t edge_bias[3];	// top-left fill rule, 0 or -1
+		float inv_area;
+		float inv_w[3];
+		float z_over_w[3];
+		float min_z;			// nearest depth, pulled in by HIZ_EPSILON so occlusion tests stay conservative
+		// screen space planes (dx, dy, c) in pixels of sum(E_i / w_i * u_i), sum(E_i / w_i * v_i) and sum(E_i / w_i),
+		// uv at any pixel is the ratio of the first two to the third, used for texture LOD
+		double uv_plane[3][3];
+
+		int min_x, min_y, max_x, max_y;
+	};
+
 	class Rasterizer
 	{
 	public:
 		typedef std::shared_ptr<Rasterizer> Ptr;
 
+		// screen is split into TILE_SIZE x TILE_SIZE tiles, each shaded by one worker
+		static const int TILE_SIZE = 64;
+		// window coordinates are snapped to 1/256 pixel
+		static const int SUBPIXEL_BITS = 8;
+		static const int SUBPIXEL_SCALE = 1 << SUBPIXEL_BITS;
+		static const int SUBPIXEL_HALF = SUBPIXEL_SCALE >> 1;
+		// keeps edge values below 2^48, where the SIMD paths convert them to double exactly
+		static constexpr float MAX_WINDOW_COORD = 1 << 14;
+		// relative slack between a triangle's vertex depths and its interpolated depths
+		static constexpr float HIZ_EPSILON = 1e-5f;
+
 		int m_width, m_height;
 
-		Rasterizer(int w, int h);
+		// num_threads <= 0 : use every hardware thread
+		// throws std::invalid_argument unless 0 < w, h < MAX_WINDOW_COORD
+		Rasterizer(int w, int h, int num_threads = 0);
+
+		// tiled = false runs the serial path, both paths write the same pixels
+		void set_tiled(bool tiled) { m_tiled = tiled; }
+
+		// defaults to the best level of the cpu, every level writes the same pixels
+		void set_simd(SimdLevel level) { m_raster_row = get_raster_row_fn(level); }
+
+		/*
+		*  deferred : draw() only fills the G-buffer (ShaderProgram::surface),
+		*			  resolve() then lights every visible pixel once (ShaderProgram::shade)
+		*     switch between frames, the shaders of a frame must stay unchanged until its resolve()
+		*/
+		void set_deferred(bool deferred);
+		void resolve();
+
+		/*
+		*  guard band : triangles that cross only the side planes, and stay within m_guard_band_size
+		*  times the viewport, skip homoClipping and are trimmed by the raster bounding box instead
+		*     on by default, off clips everything against all seven planes
+		*/
+		void set_guard_band(bool guard_band) { m_guard_band = guard_band; }
+
+		// per stage timings in frame_stats(), costs a clock read per face and per shaded pixel row
+		void set_profiling(bool profiling) { m_profiling = profiling; }
+
+		FrameStats frame_stats() const;
 
 		void set_model(const Matrix4x4& m);
 		void set_view(const Matrix4x4& v);
@@ -45,15 +152,57 @@ namespace OEngine
 		void clear(Buffers buffer);
 
 		void draw(std::vector<Triangle*>& TriangleList);
+		/*
+		*  culls the model and its meshlets against shader->m_mvp before shading, so vertex_shader must
+		*  project with m_mvp (the skybox is never culled), only vertices of visible meshlets are shaded
+		*/
 		void draw(Model::Ptr model, ShaderProgram::Ptr shader);
 
+		/*
+		*  draws the model once per instance matrix, with the bins and hiz of a single draw
+		*     the shader's vertex_shader output is taken as object space : every instance moves worldPos
+		*     and normal by its matrix and projects with shader->m_mvp * instance, the vertex_shader itself
+		*     runs once for all instances
+		*     instances whose model bounds are outside the frustum are skipped before any vertex work,
+		*     meshlets are culled per instance
+		*/
+		void draw_instanced(Model::Ptr model, ShaderProgram::Ptr shader, ArrayView<Matrix4x4> instances);
+
 		std::vector<Vector3>& frame_buffer() { return m_frame_buf; }
 
 	private:
 		void draw_line(Vector3 begin, Vector3 end);
 
 		void rasterize_triangle(const Triangle& t, const std::vector<Vector3>& worldPos);
-		void rasterize_triangle(ShaderProgram::Ptr shader, Model::Ptr model);
+
+		void begin_draw(const ShaderProgram::Ptr& shader);
+		// count items on the workers when tiled, in order on the calling thread otherwise
+		void run_stage(int count, const std::function<void(int, int)>& func);
+		int cull_meshlets(const Model& model, const Matrix4x4& mvp, const std::vector<Vector4>& planes, uint8_t* visible);
+		const uint8_t* mark_vertices(const Model& model);
+		// needed : vertices to shade, null for all of them
+		void shade_vertices(const Model& model, const ShaderProgram& shader, const uint8_t* needed);
+		// meshlet_visible : meshlets to process, null for all of them
+		void process_faces(const Model& model, const shaded_vertex* vertices, const uint8_t* meshlet_visible, int chunk, int worker,
+			std::vector<raster_triangle>& triangles);
+		void rasterize_chunks(int num_lists);
+
+		void setup_triangle(const payload& pl, int is_skybox, std::vector<raster_triangle>& triangles);
+		void bin_triangles();
+		void rasterize_tile(int tile, int worker);
+		void rasterize_triangle(const raster_triangle& tri, int worker, int x0, int y0, int x1, int y1);
+
+		/*
+		*  hierarchical z : farthest depth of every RASTER_BLOCK block and of every tile
+		*     depth only ever decreases, so a stale value is still a safe upper bound,
+		*     written blocks are only marked dirty and recomputed when they are next tested
+		*     a tile's blocks are only touched by the worker shading that tile
+		*/
+		float hiz_block(int block);
+		float hiz_tile(int tile);
+		void refresh_hiz();
+		void reset_hiz();
+		bool is_occluded(const raster_triangle& tri) const;
 
 	private:
 		Matrix4x4 m_model;
@@ -63,6 +212,67 @@ namespace OEngine
 		std::vector<Vector3> m_frame_buf;
 		std::vector<float>	 m_depth_buf;
 
+		ThreadPool::Ptr m_pool;
+		bool m_tiled = true;
+		bool m_guard_band = true;
+		float m_guard_band_size;		// in ndc units, keeps accepted window coordinates within MAX_WINDOW_COORD / 2, 0 : always clip
+		raster_row_fn m_raster_row;
+		int m_tiles_x, m_tiles_y;
+		int m_blocks_x, m_blocks_y;
+
+		std::vector<float>	 m_hiz_block;
+		std::vector<uint8_t> m_hiz_block_dirty;
+		std::vector<float>	 m_hiz_tile;
+		std::vector<uint8_t> m_hiz_tile_dirty;
+
+		// varyings and clipping scratch, one per worker
+		std::vector<payload> m_payloads;
+
+		// counters, one cache line per worker
+		struct alignas(64) worker_stats
+		{
+			uint64_t written = 0;
+			uint64_t shaded = 0;
+
+			uint64_t vertex_ns = 0;
+			uint64_t clip_ns = 0;
+			uint64_t setup_ns = 0;
+			uint64_t raster_ns = 0;
+			uint64_t fragment_ns = 0;
+			uint64_t vertices = 0;
+			uint64_t corners = 0;
+			uint64_t instances = 0;
+			uint64_t instances_culled = 0;
+			uint64_t models_culled = 0;
+			uint64_t meshlets_culled = 0;
+			uint64_t clip_results[3] = {};	// indexed by clip_result
+		};
+		std::vector<worker_stats> m_worker_stats;
+		bool m_profiling = false;
+
+		// deferred shading
+		bool m_deferred = false;
+		std::vector<gbuffer_texel>		m_gbuffer;
+		std::vector<ShaderProgram::Ptr>	m_materials;	// shader of every deferred draw of the frame, indexed by gbuffer_texel::material
+		int m_material = -1;
+
+		// per draw call
+		static const int FACE_CHUNK = 1024;
+		static const int VERTEX_CHUNK = 4096;
+		ShaderProgram::Ptr m_shader;
+		std::vector<shaded_vertex>					m_vertex_cache;	// vertex_shader output of every model vertex
+		std::vector<std::vector<raster_triangle> >	m_chunk_triangles;
+		std::vector<raster_triangle>				m_triangles;
+		std::vector<uint8_t>						m_meshlet_visible;	// per model meshlet, per visible instance when instanced
+		std::vector<uint8_t>						m_vertex_needed;
+		std::vector<std::vector<int> >				m_bins;			// triangle indices per tile, in submission order
+
+		// per draw_instanced call, visible instances only
+		std::vector<Matrix4x4>		m_instance_mvp;
+		std::vector<Matrix4x4>		m_instance_model;
+		std::vector<Matrix3x3>		m_instance_normal;		// inverse transpose of the model matrix
+		std::vector<shaded_vertex>	m_instance_vertices;	// m_vertex_cache moved by each instance, model->nverts() apiece
+
 		int get_index(int x, int y);
 	};
 } // OEngine
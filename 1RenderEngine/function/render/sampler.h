@@ -9,10 +9,5 @@
 
 namespace OEngine
 {
-	Vector3 texture_sample(Vector2 uv, TGAImage* image);
-
-	Vector3 cubemap_sample(Vector3 direction, cubemap_t* cubemap);
-
-	void generate_prefilter_map(int thread_id, int face_id, int mip_level, Model::Ptr model, TGAImage& image);
-	void generate_irradiance_map(int thread_id, int face_id, Model::Ptr model, TGAImage& image);
+	Vector3 cubemap_sample(Vector3 direction, const cubemap_t* cubemap);
 } // OEngine
@@ -1,12 +1,12 @@
 #pragma once
 
-#include "../../resource/texture.h"
 #include "../../resource/tgaimage.h"
 #include "../../core/math/math_headers.h"
 #include "../../resource/model.h"
 #include ".././platform/camera.h"
 #include "./light.h"
 #include "../render/sampler.h"
+#include "../render/ibl.h"
 
 #include <memory>
 
@@ -14,7 +14,7 @@ namespace OEngine
 {
 	static Vector3 interpolate(float alpha, float beta, float gamma, const Vector3& ver1, const Vector3& ver2, const Vector3& ver3, float weight = 1.f)
 	{
-		return Vector3((alpha * ver1 + beta * ver2, gamma * ver3) / weight);
+		return Vector3((alpha * ver1 + beta * ver2 + gamma * ver3) / weight);
 	}
 
 	static Vector2 interpolate(float alpha, float beta, float gamma, const Vector2& ver1, const Vector2& ver2, const Vector2& ver3, float weight = 1.f)
@@ -82,26 +82,56 @@ namespace OEngine
 		}
 	}
 
-	struct payload
-	{
-		Vector4 in_clipPos[3];
-		Vector3 in_worldPos[3];
-		Vector3 in_normal[3];
-		Vector2 in_texCoords[3];
+	// a triangle clipped by all 7 planes ends up with at most 3 + 7 vertices
+	static const int MAX_CLIP_VERTEX = 10;
 
+	/*
+	*  bindings shared by every invocation of a shader, read-only while drawing
+	*/
+	struct uniform
+	{
 		Model::Ptr model;
 		Camera::Ptr camera;
+		ibl_environment::Ptr ibl;		// PBRShader ambient, a constant term when null
+	};
 
-		Vector4 out_clipPos[3];
-		Vector3 out_worldPos[3];
-		Vector3 out_normal[3];
-		Vector2 out_texCoords[3];
+	/*
+	*  output of the vertex stage for one welded model vertex
+	*     the rasterizer shades every vertex of a draw once into a buffer of these,
+	*     triangles then gather their three corners from it
+	*/
+	struct shaded_vertex
+	{
+		Vector4 clipPos;
+		Vector3 worldPos;
+		Vector3 normal;
+		Vector2 uv;
+	};
+
+	/*
+	*  per-invocation varyings of one triangle plus the clipping scratch arrays
+	*     owned by the caller (one per rasterizer worker), never by the shader
+	*/
+	struct payload
+	{
+		Vector4 in_clipPos[MAX_CLIP_VERTEX];
+		Vector3 in_worldPos[MAX_CLIP_VERTEX];
+		Vector3 in_normal[MAX_CLIP_VERTEX];
+		Vector2 in_texCoords[MAX_CLIP_VERTEX];
+
+		Vector4 out_clipPos[MAX_CLIP_VERTEX];
+		Vector3 out_worldPos[MAX_CLIP_VERTEX];
+		Vector3 out_normal[MAX_CLIP_VERTEX];
+		Vector2 out_texCoords[MAX_CLIP_VERTEX];
 
 		// vertex attribute
 		Vector4 clipCoord_attri[3];
 		Vector3 worldCoord_attri[3];
 		Vector3 normal_attri[3];
 		Vector2 uv_attri[3];
+
+		// uv derivatives of the pixel's 2x2 quad, set by the rasterizer before each fragment
+		Vector4 uv_deriv;
 	};
 
 	static void transform_attri(payload& pl, int ind0, int ind1, int ind2)
@@ -187,6 +217,26 @@ namespace OEngine
 		return num_vertex;
 	}
 
+	typedef enum
+	{
+		CLIP_ACCEPTED,		// passed on unclipped
+		CLIP_REJECTED,		// entirely outside one plane
+		CLIP_CLIPPED		// went through homoClipping
+	} clip_result;
+
+	/*
+	*  surface attributes of one visible pixel, everything shade() needs to light it
+	*     the deferred path keeps one per pixel (the G-buffer), depth stays in the depth buffer
+	*/
+	struct gbuffer_texel
+	{
+		Vector3 worldPos;
+		Vector3 normal;
+		Vector2 uv;
+		Vector4 duv;			// du/dx, dv/dx, du/dy, dv/dy of the pixel's quad, selects the texture LOD
+		int material = -1;		// index of the draw call's shader in the rasterizer, -1 : nothing drawn
+	};
+
 	struct fragment_shader_payload
 	{
 		fragment_shader_payload() {}
@@ -210,7 +260,7 @@ namespace OEngine
 	public:
 		typedef std::shared_ptr<ShaderProgram> Ptr;
 
-		payload m_payload;
+		uniform m_uniform;
 
 		Light m_light;
 
@@ -220,8 +270,38 @@ namespace OEngine
 		Matrix4x4 m_mvp				= Matrix4x4::IDENTITY;
 
 	public:
-		virtual void vertex_shader(int nfaces, int nvertex) {}
-		virtual Vector3 fragment_shader(float alpha, float gamma, float beta) { return Vector3(255, 255, 255); }
+		virtual ~ShaderProgram() = default;
+
+		// const : a single shader is shared by all rasterizer workers, runs once per vertex index of the model
+		virtual void vertex_shader(int /*index*/, shaded_vertex& /*out*/) const {}
+
+		/*
+		*  fragment stage, split in two so the deferred path can run them in separate passes
+		*     surface : interpolates the triangle's varyings into a texel, the default is perspective correct
+		*     shade	  : lights a texel, runs once per visible pixel when rendering deferred
+		*/
+		virtual void surface(const payload& pl, float alpha, float gamma, float beta, gbuffer_texel& texel) const
+		{
+			const Vector4* clipPos = pl.clipCoord_attri;
+			float Z = 1.f / (alpha / clipPos[0].w + gamma / clipPos[1].w + beta / clipPos[2].w);
+
+			texel.worldPos = (alpha * pl.worldCoord_attri[0] / clipPos[0].w + gamma * pl.worldCoord_attri[1] / clipPos[1].w
+				+ beta * pl.worldCoord_attri[2] / clipPos[2].w) * Z;
+			texel.normal = (alpha * pl.normal_attri[0] / clipPos[0].w + gamma * pl.normal_attri[1] / clipPos[1].w
+				+ beta * pl.normal_attri[2] / clipPos[2].w) * Z;
+			texel.uv = (alpha * pl.uv_attri[0] / clipPos[0].w + gamma * pl.uv_attri[1] / clipPos[1].w
+				+ beta * pl.uv_attri[2] / clipPos[2].w) * Z;
+		}
+		virtual Vector3 shade(const gbuffer_texel& /*texel*/) const { return Vector3(255, 255, 255); }
+
+		// forward rendering : both halves back to back
+		virtual Vector3 fragment_shader(const payload& pl, float alpha, float gamma, float beta) const
+		{
+			gbuffer_texel texel;
+			texel.duv = pl.uv_deriv;
+			surface(pl, alpha, gamma, beta, texel);
+			return shade(texel);
+		}
 
 		inline void set_model(const Matrix4x4& model) { m_model = model; }
 		inline void set_view(const Matrix4x4& view) { m_view = view; }
@@ -233,8 +313,9 @@ namespace OEngine
 	public:
 		typedef std::shared_ptr<PhongShader> Ptr;
 
-		void vertex_shader(int nfaces, int nvertex);
-		Vector3 fragment_shader(float alpha, float gamma, float beta);
+		void vertex_shader(int index, shaded_vertex& out) const;
+		void surface(const payload& pl, float alpha, float gamma, float beta, gbuffer_texel& texel) const;
+		Vector3 shade(const gbuffer_texel& texel) const;
 	};
 
 	class SkyBoxShader : public ShaderProgram
@@ -242,8 +323,8 @@ namespace OEngine
 	public:
 		typedef std::shared_ptr<SkyBoxShader> Ptr;
 
-		void vertex_shader(int nfaces, int nvertex);
-		Vector3 fragment_shader(float alpha, float gamma, float beta);
+		void vertex_shader(int index, shaded_vertex& out) const;
+		Vector3 shade(const gbuffer_texel& texel) const;
 	};
 
 	class PBRShader : public ShaderProgram
@@ -251,7 +332,8 @@ namespace OEngine
 	public:
 		typedef std::shared_ptr<PBRShader> Ptr;
 
-		void vertex_shader(int nfaces, int nvertex);
-		Vector3 fragment_shader(float alpha, float gamma, float beta);
+		void vertex_shader(int index, shaded_vertex& out) const;
+		void surface(const payload& pl, float alpha, float gamma, float beta, gbuffer_texel& texel) const;
+		Vector3 shade(const gbuffer_texel& texel) const;
 	};
 } // OEngine
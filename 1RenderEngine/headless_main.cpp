@@ -0,0 +1,268 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+
+#include "core/math/math_headers.h"
+#include "function/render/rasterizer.h"
+#include "function/render/ibl.h"
+#include "function/render/light.h"
+#include "resource/model.h"
+#include "resource/resource_manager.h"
+#include "function/platform/camera.h"
+#include "function/platform/headless.h"
+
+/*
+*  batch renderer : same pipeline as main.cpp, no window
+*     renders frames [start, start + count) of an N frame camera path and writes one image per frame,
+*     so a long sequence can be split across machines with --start / --count
+*
+*     camera path : an orbit around the target by default, or a keyframe file with one
+*                   "eye_x eye_y eye_z target_x target_y target_z" line per key, sampled linearly
+*/
+
+struct options
+{
+	std::string model;
+	std::string skybox;
+	std::string shader		= "phong";
+	std::string path;
+	std::string out_dir		= ".";
+	std::string prefix		= "frame";
+	OEngine::ImageFormat format = OEngine::ImageFormat::TGA;
+	int width				= 800;
+	int height				= 600;
+	int frames				= 60;
+	int start				= 0;
+	int count				= -1;
+	int threads				= 0;
+	bool deferred			= false;
+	bool ibl				= false;
+};
+
+struct camera_key
+{
+	OEngine::Vector3 eye;
+	OEngine::Vector3 target;
+};
+
+static void print_usage()
+{
+	std::cerr <<
+		"usage: render_headless <model.obj> [options]\n"
+		"  --shader phong|pbr      surface shader (phong)\n"
+		"  --skybox <box.obj>      draw a skybox model behind the scene\n"
+		"  --ibl                   light pbr with the skybox, baked once into <box>.oibl\n"
+		"  --size <w>x<h>          frame size (800x600)\n"
+		"  --frames <n>            length of the camera path (60)\n"
+		"  --start <i>             first frame to render (0)\n"
+		"  --count <n>             number of frames to render (all remaining)\n"
+		"  --path <file>           camera keyframes, default is an orbit\n"
+		"  --out <dir>             output directory (.)\n"
+		"  --prefix <name>         output file prefix (frame)\n"
+		"  --format tga|ppm        output format (tga)\n"
+		"  --threads <n>           rasterizer threads, 0 = all (0)\n"
+		"  --deferred              deferred shading\n";
+}
+
+static bool parse_options(int argc, char** argv, options& opt)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (arg == "--deferred")
+			opt.deferred = true;
+		else if (arg == "--ibl")
+			opt.ibl = true;
+		else if (arg == "--shader" && has_value)
+			opt.shader = argv[++i];
+		else if (arg == "--skybox" && has_value)
+			opt.skybox = argv[++i];
+		else if (arg == "--size" && has_value)
+		{
+			if (sscanf(argv[++i], "%dx%d", &opt.width, &opt.height) != 2)
+				return false;
+		}
+		else if (arg == "--frames" && has_value)
+			opt.frames = atoi(argv[++i]);
+		else if (arg == "--start" && has_value)
+			opt.start = atoi(argv[++i]);
+		else if (arg == "--count" && has_value)
+			opt.count = atoi(argv[++i]);
+		else if (arg == "--path" && has_value)
+			opt.path = argv[++i];
+		else if (arg == "--out" && has_value)
+			opt.out_dir = argv[++i];
+		else if (arg == "--prefix" && has_value)
+			opt.prefix = argv[++i];
+		else if (arg == "--format" && has_value)
+		{
+			std::string format = argv[++i];
+			if (format == "tga")		opt.format = OEngine::ImageFormat::TGA;
+			else if (format == "ppm")	opt.format = OEngine::ImageFormat::PPM;
+			else return false;
+		}
+		else if (arg == "--threads" && has_value)
+			opt.threads = atoi(argv[++i]);
+		else if (arg[0] != '-' && opt.model.empty())
+			opt.model = arg;
+		else
+			return false;
+	}
+
+	if (opt.count < 0)
+		opt.count = opt.frames - opt.start;
+
+	return !opt.model.empty() && opt.width > 0 && opt.height > 0 && opt.frames > 0
+		&& opt.width < OEngine::Rasterizer::MAX_WINDOW_COORD && opt.height < OEngine::Rasterizer::MAX_WINDOW_COORD
+		&& opt.start >= 0 && opt.start + opt.count <= opt.frames
+		&& (opt.shader == "phong" || opt.shader == "pbr") && (!opt.ibl || !opt.skybox.empty());
+}
+
+static bool load_path(const std::string& filename, std::vector<camera_key>& keys)
+{
+	std::ifstream in(filename);
+	if (in.fail())
+		return false;
+
+	std::string line;
+	while (std::getline(in, line))
+	{
+		std::istringstream iss(line);
+		camera_key key;
+		if (iss >> key.eye.x >> key.eye.y >> key.eye.z >> key.target.x >> key.target.y >> key.target.z)
+			keys.push_back(key);
+	}
+	return !keys.empty();
+}
+
+// camera of frame i along the path
+static camera_key sample_path(const std::vector<camera_key>& keys, int frame, int frames)
+{
+	float t = frames > 1 ? (float)frame / (frames - 1) : 0.f;
+
+	if (keys.empty())
+	{
+		// one full turn around the default target, starting where main.cpp starts
+		const OEngine::Vector3 target{ 0, 1, 0 };
+		const float radius = 5.f;
+		float angle = 2.f * OEngine::Math_PI * (float)frame / frames;
+
+		camera_key key;
+		key.target = target;
+		key.eye = target + OEngine::Vector3(radius * std::sin(angle), 0.f, radius * std::cos(angle));
+		return key;
+	}
+
+	float pos = t * (keys.size() - 1);
+	int k = std::min((int)pos, (int)keys.size() - 2);
+	if (k < 0)
+		return keys[0];
+
+	float s = pos - k;
+	camera_key key;
+	key.eye = OEngine::Vector3::lerp(keys[k].eye, keys[k + 1].eye, s);
+	key.target = OEngine::Vector3::lerp(keys[k].target, keys[k + 1].target, s);
+	return key;
+}
+
+int main(int argc, char** argv)
+{
+	options opt;
+	if (!parse_options(argc, argv, opt))
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::vector<camera_key> keys;
+	if (!opt.path.empty() && !load_path(opt.path, keys))
+	{
+		std::cerr << "camera path load failed..." << opt.path << '\n';
+		return 1;
+	}
+
+	auto m = OEngine::ResourceManager::getInstance().model(opt.model);
+	if (!m)
+		return 1;
+	// every frame is rendered with the final textures
+	m->wait_all();
+
+	OEngine::Model::Ptr skyBox;
+	if (!opt.skybox.empty())
+		skyBox = OEngine::ResourceManager::getInstance().model(opt.skybox, 1);
+
+	auto r = std::make_shared<OEngine::Rasterizer>(opt.width, opt.height, opt.threads);
+	r->set_deferred(opt.deferred);
+
+	const OEngine::Vector3 UP{ 0, 1, 0 };
+	auto camera = std::make_shared<OEngine::Camera>(OEngine::Vector3(0, 1, 5), OEngine::Vector3(0, 1, 0), UP, (float)opt.width / opt.height);
+
+	OEngine::ShaderProgram::Ptr shader;
+	if (opt.shader == "pbr")
+		shader = std::make_shared<OEngine::PBRShader>();
+	else
+		shader = std::make_shared<OEngine::PhongShader>();
+
+	shader->m_uniform.model = m;
+	shader->m_uniform.camera = camera;
+	shader->m_light.position = OEngine::Vector3(0, 0, 1);
+	shader->m_light.intensity = OEngine::Vector3(500, 500, 500);
+
+	// diffuse from the SH9 projection, the irradiance map is not worth its bake time here
+	if (opt.ibl && skyBox && opt.shader == "pbr")
+	{
+		OEngine::ibl_bake_options ibl_options;
+		ibl_options.irradiance_size = 0;
+		std::string bundle = std::filesystem::path(opt.skybox).replace_extension(".oibl").string();
+		shader->m_uniform.ibl = OEngine::load_or_bake_ibl(skyBox->environment_map, bundle, ibl_options);
+	}
+
+	auto skyboxShader = std::make_shared<OEngine::SkyBoxShader>();
+	skyboxShader->m_uniform.model = skyBox;
+	skyboxShader->m_uniform.camera = camera;
+
+	OEngine::Matrix4x4 projection = OEngine::Math::makePerspectiveMatrix(OEngine::Radian(OEngine::Degree(45.f)), camera->aspect, -0.1, -100);
+
+	for (int frame = opt.start; frame < opt.start + opt.count; frame++)
+	{
+		camera_key key = sample_path(keys, frame, opt.frames);
+		camera->m_eye = key.eye;
+		camera->m_target = key.target;
+
+		OEngine::Matrix4x4 view = OEngine::Math::makeLookAtMatrix(camera->m_eye, camera->m_target, camera->m_up);
+		shader->m_view = view;
+		shader->m_mvp = projection * view;
+
+		// the skybox follows the camera, only its rotation is kept
+		OEngine::Matrix4x4 viewSky = view;
+		viewSky[0][3] = 0;
+		viewSky[1][3] = 0;
+		viewSky[2][3] = 0;
+		skyboxShader->m_view = viewSky;
+		skyboxShader->m_mvp = projection * viewSky;
+
+		r->clear(OEngine::Buffers::Color | OEngine::Buffers::Depth);
+		r->draw(m, shader);
+		if (skyBox)
+			r->draw(skyBox, skyboxShader);
+		r->resolve();
+
+		std::string filename = OEngine::frame_path(opt.out_dir, opt.prefix, frame, opt.format);
+		if (!OEngine::image_write(filename, r->frame_buffer(), opt.width, opt.height, opt.format))
+		{
+			std::cerr << "frame write failed..." << filename << '\n';
+			return 1;
+		}
+		std::cout << filename << '\n';
+	}
+
+	return 0;
+}
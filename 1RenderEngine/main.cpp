@@ -5,6 +5,7 @@
 #include "function/render/light.h"
 #include "resource/OBJ_Loader.h"
 #include "resource/model.h"
+#include "resource/resource_manager.h"
 #include "function/platform/scene.h"
 #include "function/platform/camera.h"
 #include "./core/base/timer.h"
@@ -36,8 +37,10 @@ int main()
 
 	OEngine::window_init(M_WIDTH, M_HEIGHT, "OERender");
 
-	auto m = std::make_shared<OEngine::Model>("./models/helmet/helmet.obj");
-	auto skyBox = std::make_shared<OEngine::Model>("./models/skybox2/box.obj", 1);
+	auto m = OEngine::ResourceManager::getInstance().model("./models/helmet/helmet.obj");
+	auto skyBox = OEngine::ResourceManager::getInstance().model("./models/skybox2/box.obj", 1);
+	if (!m || !skyBox)
+		return 1;
 
 	auto r = std::make_shared<OEngine::Rasterizer>(M_WIDTH, M_HEIGHT);
 	// OEngine::Scene scene(NAME, 30, r);
@@ -66,17 +69,17 @@ int main()
 	auto PBRShader	  = std::make_shared<OEngine::PBRShader>();
 
 	shader->set_model(model);
-	shader->m_payload.model = m;
-	shader->m_payload.camera = EUT_CAMERA;
+	shader->m_uniform.model = m;
+	shader->m_uniform.camera = EUT_CAMERA;
 	shader->m_light.position = OEngine::Vector3(0, 0, 1);
 	shader->m_light.intensity = OEngine::Vector3(500, 500, 500);
 
-	skyboxShader->m_payload.model = skyBox;
-	skyboxShader->m_payload.camera = EUT_CAMERA;
+	skyboxShader->m_uniform.model = skyBox;
+	skyboxShader->m_uniform.camera = EUT_CAMERA;
 
 	PBRShader->set_model(model);
-	PBRShader->m_payload.model = m;
-	PBRShader->m_payload.camera = EUT_CAMERA;
+	PBRShader->m_uniform.model = m;
+	PBRShader->m_uniform.camera = EUT_CAMERA;
 
 	while (!OEngine::window->is_close)
 	{
@@ -94,6 +97,8 @@ int main()
 		// r->draw(skyBox, skyboxShader);
 		// r->draw(m, shader);
 		r->draw(m, PBRShader);
+		// lights the G-buffer when deferred, nothing to do when forward
+		r->resolve();
 
 		OEngine::window->mouse_info.wheel_delta = 0;
 		OEngine::window->mouse_info.orbit_delta = OEngine::Vector2(0, 0);
@@ -0,0 +1,240 @@
+#include "./hdr_image.h"
+#include "../core/base/mapped_file.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+namespace OEngine
+{
+	// shared exponent, 8 bit mantissas : value = mantissa * 2^(e - 136)
+	static inline Vector3 decode_rgbe(const uint8_t* rgbe)
+	{
+		if (rgbe[3] == 0)
+			return Vector3(0.f, 0.f, 0.f);
+		float scale = std::ldexp(1.f, (int)rgbe[3] - (128 + 8));
+		return Vector3(rgbe[0] * scale, rgbe[1] * scale, rgbe[2] * scale);
+	}
+
+	static inline void encode_rgbe(const Vector3& color, uint8_t* rgbe)
+	{
+		float r = std::max(color.x, 0.f), g = std::max(color.y, 0.f), b = std::max(color.z, 0.f);
+		float largest = std::max(r, std::max(g, b));
+		if (largest < 1e-32f)
+		{
+			rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+			return;
+		}
+
+		int exponent;
+		float scale = std::frexp(largest, &exponent) * 256.f / largest;
+		rgbe[0] = (uint8_t)(r * scale);
+		rgbe[1] = (uint8_t)(g * scale);
+		rgbe[2] = (uint8_t)(b * scale);
+		rgbe[3] = (uint8_t)(exponent + 128);
+	}
+
+	static const char* next_line(const char* p, const char* end, std::string& line)
+	{
+		const char* eol = std::find(p, end, '\n');
+		line.assign(p, eol);
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		return eol < end ? eol + 1 : nullptr;
+	}
+
+	/*
+	*  one scanline into width RGBE texels
+	*     new style RLE starts with 2, 2, width (16 bit big endian) and stores the four channels one
+	*     after the other, each as runs (count > 128 : one byte repeated count - 128 times) and
+	*     literal spans, anything else is a flat scanline
+	*/
+	static const uint8_t* read_scanline(const uint8_t* p, const uint8_t* end, int width, uint8_t* rgbe)
+	{
+		bool rle = width >= 8 && width < 0x8000 && end - p >= 4
+			&& p[0] == 2 && p[1] == 2 && !(p[2] & 0x80) && ((p[2] << 8) | p[3]) == width;
+		if (!rle)
+		{
+			if (end - p < (ptrdiff_t)width * 4)
+				return nullptr;
+			memcpy(rgbe, p, (size_t)width * 4);
+			return p + (size_t)width * 4;
+		}
+
+		p += 4;
+		for (int c = 0; c < 4; c++)
+		{
+			for (int x = 0; x < width;)
+			{
+				if (p >= end)
+					return nullptr;
+				int count = *p++;
+				if (count > 128)
+				{
+					count -= 128;
+					if (p >= end || x + count > width)
+						return nullptr;
+					uint8_t value = *p++;
+					for (int i = 0; i < count; i++)
+						rgbe[(x + i) * 4 + c] = value;
+				}
+				else
+				{
+					if (count == 0 || end - p < count || x + count > width)
+						return nullptr;
+					for (int i = 0; i < count; i++)
+						rgbe[(x + i) * 4 + c] = *p++;
+				}
+				x += count;
+			}
+		}
+		return p;
+	}
+
+	bool read_hdr_file(const std::string& path, hdr_image& image, bool bottom_up)
+	{
+		MappedFile file;
+		if (!file.open(path))
+		{
+			std::cerr << "can't open file " << path << '\n';
+			return false;
+		}
+
+		const char* p = (const char*)file.data();
+		const char* end = p + file.size();
+		std::string line;
+
+		// "#?RADIANCE" (or "#?RGBE"), variables, a blank line, then the resolution
+		p = next_line(p, end, line);
+		if (!p || line.compare(0, 2, "#?") != 0)
+		{
+			std::cerr << "not a radiance file " << path << '\n';
+			return false;
+		}
+		while (p && (p = next_line(p, end, line)) && !line.empty())
+		{
+			if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe")
+			{
+				std::cerr << "unsupported format " << line.substr(7) << " in " << path << '\n';
+				return false;
+			}
+		}
+		if (!p || !(p = next_line(p, end, line)))
+			return false;
+
+		char y_sign, x_sign, y_axis, x_axis;
+		int width, height;
+		if (sscanf(line.c_str(), "%c%c %d %c%c %d", &y_sign, &y_axis, &height, &x_sign, &x_axis, &width) != 6
+			|| y_axis != 'Y' || x_axis != 'X' || x_sign != '+' || (y_sign != '-' && y_sign != '+')
+			|| width <= 0 || height <= 0)
+		{
+			std::cerr << "unsupported resolution \"" << line << "\" in " << path << '\n';
+			return false;
+		}
+		bool file_bottom_up = y_sign == '+';
+
+		image.width = width;
+		image.height = height;
+		image.texels.resize((size_t)width * height);
+
+		const uint8_t* data = (const uint8_t*)p;
+		const uint8_t* data_end = (const uint8_t*)end;
+		std::vector<uint8_t> rgbe((size_t)width * 4);
+		for (int row = 0; row < height; row++)
+		{
+			data = read_scanline(data, data_end, width, rgbe.data());
+			if (!data)
+			{
+				std::cerr << "truncated scanline " << row << " in " << path << '\n';
+				return false;
+			}
+
+			int y = file_bottom_up == bottom_up ? row : height - 1 - row;
+			Vector3* dst = &image.texels[(size_t)y * width];
+			for (int x = 0; x < width; x++)
+				dst[x] = decode_rgbe(&rgbe[(size_t)x * 4]);
+		}
+		return true;
+	}
+
+	// runs shorter than 4 bytes cost more as runs than as literals
+	static void write_channel(FILE* file, const uint8_t* rgbe, int width, int c)
+	{
+		const int MIN_RUN = 4;
+		int x = 0;
+		while (x < width)
+		{
+			// find the next run long enough to be worth encoding
+			int run_start = x, run_count = 0;
+			while (run_start < width)
+			{
+				run_count = 1;
+				while (run_start + run_count < width && run_count < 127
+					&& rgbe[(run_start + run_count) * 4 + c] == rgbe[run_start * 4 + c])
+					run_count++;
+				if (run_count >= MIN_RUN)
+					break;
+				run_start += run_count;
+			}
+			if (run_start >= width)
+				run_count = 0;
+
+			// literals up to the run
+			while (x < run_start)
+			{
+				int count = std::min(run_start - x, 128);
+				uint8_t header = (uint8_t)count;
+				fwrite(&header, 1, 1, file);
+				for (int i = 0; i < count; i++)
+					fwrite(&rgbe[(x + i) * 4 + c], 1, 1, file);
+				x += count;
+			}
+			if (run_count >= MIN_RUN)
+			{
+				uint8_t run[2] = { (uint8_t)(128 + run_count), rgbe[run_start * 4 + c] };
+				fwrite(run, 1, 2, file);
+				x += run_count;
+			}
+		}
+	}
+
+	bool write_hdr_file(const std::string& path, int width, int height, const Vector3* texels, bool bottom_up)
+	{
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file)
+		{
+			std::cerr << "can't open file " << path << '\n';
+			return false;
+		}
+
+		fprintf(file, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", height, width);
+
+		bool rle = width >= 8 && width < 0x8000;
+		std::vector<uint8_t> rgbe((size_t)width * 4);
+		for (int row = 0; row < height; row++)
+		{
+			int y = bottom_up ? height - 1 - row : row;
+			for (int x = 0; x < width; x++)
+				encode_rgbe(texels[(size_t)y * width + x], &rgbe[(size_t)x * 4]);
+
+			if (!rle)
+			{
+				fwrite(rgbe.data(), 1, rgbe.size(), file);
+				continue;
+			}
+			uint8_t header[4] = { 2, 2, (uint8_t)(width >> 8), (uint8_t)(width & 0xff) };
+			fwrite(header, 1, 4, file);
+			for (int c = 0; c < 4; c++)
+				write_channel(file, rgbe.data(), width, c);
+		}
+
+		bool ok = !ferror(file);
+		fclose(file);
+		if (!ok)
+			std::cerr << "can't write file " << path << '\n';
+		return ok;
+	}
+} // OEngine
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "../core/math/math_headers.h"
+
+/*
+*  Radiance RGBE (.hdr) reader / writer
+*     flat and run length encoded scanlines are read, only the standard "-Y h +X w" (top down)
+*     and "+Y h +X w" (bottom up) orientations are accepted, XYZE files are rejected
+*     texels come back as linear float RGB, not clamped
+*/
+
+namespace OEngine
+{
+	struct hdr_image
+	{
+		int width = 0;
+		int height = 0;
+		std::vector<Vector3> texels;		// row major, row 0 at the top unless read bottom_up
+	};
+
+	bool read_hdr_file(const std::string& path, hdr_image& image, bool bottom_up = false);
+
+	// run length encoded, top down rows unless bottom_up
+	bool write_hdr_file(const std::string& path, int width, int height, const Vector3* texels, bool bottom_up = false);
+} // OEngine
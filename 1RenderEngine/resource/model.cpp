@@ -1,70 +1,146 @@
 #include "./model.h"
+#include "./resource_manager.h"
+#include "../core/base/hash.h"
+#include "../core/base/timer.h"
+#include "../core/base/thread_pool.h"
 
-#include <io.h>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
 
 namespace OEngine
 {
+	// portable replacement for _access(path, 0)
+	static bool file_exists(const std::string& path)
+	{
+		std::ifstream file(path, std::ifstream::binary);
+		return file.good();
+	}
+
+	/*
+	*  .omesh layout : header, then each array at a 16 byte aligned offset
+	*     the header is written last, a partially written file never has a valid magic
+	*/
+	static const char MESH_CACHE_MAGIC[4] = { 'O', 'M', 'S', 'H' };
+	static const uint32_t MESH_CACHE_VERSION = 2;
+	static const size_t MESH_CACHE_ALIGN = 16;
+
+	struct mesh_cache_header
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t source_size;
+		int64_t source_mtime;
+		uint64_t source_hash;
+		uint32_t num_vertices;
+		uint32_t num_indices;
+		float bounds_min[3];
+		float bounds_max[3];
+		// byte offsets from the start of the file
+		uint64_t positions;
+		uint64_t normals;
+		uint64_t texcoords;
+		uint64_t tangents;
+		uint64_t indices;
+		// submesh ranges, then "name\0material\0" per submesh and "mtllib\0" per library
+		uint32_t num_submeshes;
+		uint32_t num_material_libs;
+		uint64_t submeshes;
+		uint64_t strings;
+		uint64_t strings_size;
+	};
+
+	struct mesh_cache_submesh
+	{
+		uint32_t first_index;
+		uint32_t index_count;
+	};
+
+	static_assert(sizeof(Vector2) == 8 && sizeof(Vector3) == 12 && sizeof(Vector4) == 16, "mesh cache stores vectors as packed floats");
+
+	static std::string mesh_cache_path(const std::string& filename)
+	{
+		size_t dot = filename.find_last_of('.');
+		size_t slash = filename.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+			return filename + ".omesh";
+		return filename.substr(0, dot) + ".omesh";
+	}
+
+	static bool read_source_stamp(const std::string& filename, mesh_source_stamp& stamp)
+	{
+		std::error_code error;
+		auto mtime = std::filesystem::last_write_time(filename, error);
+		if (error)
+			return false;
+
+		MappedFile source;
+		if (!source.open(filename))
+			return false;
+
+		stamp.size = source.size();
+		stamp.mtime = (int64_t)mtime.time_since_epoch().count();
+		stamp.hash = hash_bytes(source.data(), source.size());
+		return true;
+	}
+
+	static uint64_t align_offset(uint64_t offset)
+	{
+		return (offset + MESH_CACHE_ALIGN - 1) & ~(uint64_t)(MESH_CACHE_ALIGN - 1);
+	}
+
+	bool Model::s_mesh_cache = true;
+
+	// texture decode runs here, shared by every model
+	static ThreadPool& loader_pool()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
 	Model::Model(const char* filename, int is_skyb) : is_skybox(is_skyb)
 	{
-		std::ifstream in;
-		in.open(filename, std::ifstream::in);
-		if (in.fail())
+		for (auto& slot : m_maps)
+			slot.store(nullptr, std::memory_order_relaxed);
+
+		Timer timer(true);
+
+		std::string cache_path = mesh_cache_path(filename);
+		mesh_source_stamp stamp;
+		bool cacheable = s_mesh_cache && read_source_stamp(filename, stamp);
+
+		if (cacheable && load_cache(cache_path, stamp))
 		{
-			std::cerr << "model load failed..." << filename << '\n';
-			return;
+			m_load_stats.from_cache = true;
+			std::cerr << "# mesh cache " << cache_path << '\n';
 		}
-
-		std::string line;
-		while (!in.eof())
+		else
 		{
-			std::getline(in, line);
-			std::istringstream iss(line.c_str());
-			char trash;
-			if (!line.compare(0, 2, "v "))
-			{
-				iss >> trash;
-				Vector3 v;
-				for (int i = 0; i < 3; i++)
-					iss >> v[i];
-				m_verts.push_back(v);
-			}
-			else if (!line.compare(0, 3, "vn "))
+			if (!load_obj(filename))
 			{
-				iss >> trash >> trash;
-				Vector3 n;
-				for (int i = 0; i < 3; i++)
-					iss >> n[i];
-				m_norms.push_back(n);
-			}
-			else if (!line.compare(0, 3, "vt "))
-			{
-				iss >> trash >> trash;
-				Vector2 uv;
-				for (int i = 0; i < 2; i++)
-					iss >> uv[i];
-				m_uvs.push_back(uv);
-			}
-			else if (!line.compare(0, 2, "f "))
-			{
-				std::vector<int> f;
-				int tmp[3];
-				iss >> trash;
-				while (iss >> tmp[0] >> trash >> tmp[1] >> trash >> tmp[2])
-				{
-					for (int i = 0; i < 3; i++)
-						tmp[i]--;
-					f.push_back(tmp[0]);
-					f.push_back(tmp[1]);
-					f.push_back(tmp[2]);
-				}
-				m_faces.push_back(f);
+				std::cerr << "model load failed..." << filename << '\n';
+				return;
 			}
+
+			generate_tangents();
+			compute_bounds();
+			bind_storage();
+
+			if (cacheable && nfaces() > 0 && !write_cache(cache_path, stamp))
+				std::cerr << "mesh cache write failed..." << cache_path << '\n';
 		}
-		std::cerr << "# v#" << m_verts.size() << " f# " << m_faces.size() << " #vt " << m_uvs.size()
-			<< " vn# " << m_norms.size() << std::endl;
+		build_meshlets();
+		load_materials(filename);
+
+		std::error_code error;
+		m_load_stats.source_bytes = std::filesystem::file_size(filename, error);
+		m_load_stats.load_ms = timer.elapsed_ms();
+		std::cerr << "# v#" << m_positions.size() << " f# " << nfaces() << " #idx " << m_indices.size() << std::endl;
 
 		create_map(filename);
 
@@ -78,157 +154,550 @@ namespace OEngine
 
 	Model::~Model()
 	{
-		if (diffuse_map)	delete diffuse_map;		diffuse_map = NULL;
-		if (normal_map)		delete normal_map;		normal_map = NULL;
-		if (specular_map)	delete specular_map;	specular_map = NULL;
-		if (roughness_map)	delete roughness_map;	roughness_map = NULL;
-		if (metalness_map)	delete metalness_map;	metalness_map = NULL;
-		if (occlusion_map)	delete occlusion_map;	occlusion_map = NULL;
-		if (emision_map)	delete emision_map;		emision_map = NULL;
+		// loads still in flight write into this model
+		wait_all();
 
 		if (environment_map)
-		{
-			for (int i = 0; i < 6; i++)
-				delete environment_map->faces[i];
 			delete environment_map;
+	}
+
+	bool Model::load_obj(const char* filename)
+	{
+		obj_mesh mesh;
+		if (!parse_obj(filename, mesh))
+			return false;
+
+		m_storage.positions = std::move(mesh.positions);
+		m_storage.normals = std::move(mesh.normals);
+		m_storage.texcoords = std::move(mesh.texcoords);
+		m_storage.indices = std::move(mesh.indices);
+		m_submeshes = std::move(mesh.submeshes);
+		m_material_libs = std::move(mesh.material_libs);
+		return true;
+	}
+
+	// "mtllib" paths are relative to the OBJ
+	void Model::load_materials(const char* filename)
+	{
+		std::string dir = filename;
+		size_t slash = dir.find_last_of("/\\");
+		dir = slash == std::string::npos ? "" : dir.substr(0, slash + 1);
+
+		for (const auto& lib : m_material_libs)
+			if (!parse_mtl(dir + lib, m_materials))
+				std::cerr << "material load failed..." << dir + lib << '\n';
+	}
+
+	void Model::generate_tangents()
+	{
+		std::vector<Vector3> tan(m_storage.positions.size(), Vector3(0.f, 0.f, 0.f));
+		std::vector<Vector3> bitan(m_storage.positions.size(), Vector3(0.f, 0.f, 0.f));
+
+		// per face tangent frame from the uv gradients, summed over the faces sharing a vertex
+		for (size_t i = 0; i < m_storage.indices.size(); i += 3)
+		{
+			uint32_t a = m_storage.indices[i], b = m_storage.indices[i + 1], c = m_storage.indices[i + 2];
+
+			Vector3 e1 = m_storage.positions[b] - m_storage.positions[a];
+			Vector3 e2 = m_storage.positions[c] - m_storage.positions[a];
+			float du1 = m_storage.texcoords[b].x - m_storage.texcoords[a].x;
+			float dv1 = m_storage.texcoords[b].y - m_storage.texcoords[a].y;
+			float du2 = m_storage.texcoords[c].x - m_storage.texcoords[a].x;
+			float dv2 = m_storage.texcoords[c].y - m_storage.texcoords[a].y;
+
+			float det = du1 * dv2 - du2 * dv1;
+			if (std::fabs(det) < Float_EPSILON)
+				continue;
+
+			Vector3 t = (e1 * dv2 - e2 * dv1) / det;
+			Vector3 bt = (e2 * du1 - e1 * du2) / det;
+			for (uint32_t v : { a, b, c })
+			{
+				tan[v] += t;
+				bitan[v] += bt;
+			}
+		}
+
+		m_storage.tangents.resize(m_storage.positions.size());
+		for (size_t v = 0; v < m_storage.positions.size(); v++)
+		{
+			Vector3 n = m_storage.normals[v].normalizedCopy();
+
+			// Gram-Schmidt against the normal, any perpendicular axis when the uvs are degenerate
+			Vector3 t = tan[v] - n * n.dotProduct(tan[v]);
+			if (t.squaredLength() < Float_EPSILON)
+				t = n.crossProduct(std::fabs(n.x) < 0.9f ? Vector3::UNIT_X : Vector3::UNIT_Y);
+			t.normalise();
+
+			float w = n.crossProduct(t).dotProduct(bitan[v]) < 0.f ? -1.f : 1.f;
+			m_storage.tangents[v] = Vector4(t.x, t.y, t.z, w);
 		}
 	}
 
-	void Model::create_map(const char* filename)
+	void Model::compute_bounds()
 	{
-		diffuse_map		= NULL;
-		normal_map		= NULL;
-		specular_map	= NULL;
-		roughness_map	= NULL;
-		metalness_map	= NULL;
-		occlusion_map	= NULL;
-		emision_map		= NULL;
+		m_bounds_min = Vector3(0.f, 0.f, 0.f);
+		m_bounds_max = Vector3(0.f, 0.f, 0.f);
+		if (m_storage.positions.empty())
+			return;
 
-		std::string texfile(filename);
-		size_t dot = texfile.find_last_of(".");
+		m_bounds_min = m_bounds_max = m_storage.positions[0];
+		for (const Vector3& p : m_storage.positions)
+		{
+			m_bounds_min.makeFloor(p);
+			m_bounds_max.makeCeil(p);
+		}
+	}
 
-		// diffuse_map
-		texfile = texfile.substr(0, dot) + std::string("_diffuse.tga");
-		if (_access(texfile.data(), 0) != -1)
+	void Model::build_meshlets()
+	{
+		m_bounds_center = (m_bounds_min + m_bounds_max) * 0.5f;
+		m_bounds_radius = 0.f;
+		for (const Vector3& p : m_positions)
+			m_bounds_radius = std::max(m_bounds_radius, (p - m_bounds_center).length());
+
+		m_meshlets.clear();
+		int num_faces = nfaces();
+		for (int first = 0; first < num_faces; first += MESHLET_FACES)
 		{
-			diffuse_map = new TGAImage();
-			load_texture(filename, "_diffuse.tga", diffuse_map);
+			meshlet cluster;
+			cluster.first_face = (uint32_t)first;
+			cluster.num_faces = (uint32_t)std::min(MESHLET_FACES, num_faces - first);
+
+			// bounds, and the mean of the face normals as the cone axis
+			cluster.bounds_min = cluster.bounds_max = m_positions[m_indices[first * 3]];
+			Vector3 axis(0.f, 0.f, 0.f);
+			for (int f = first; f < first + (int)cluster.num_faces; f++)
+			{
+				const Vector3& a = m_positions[m_indices[f * 3]];
+				const Vector3& b = m_positions[m_indices[f * 3 + 1]];
+				const Vector3& c = m_positions[m_indices[f * 3 + 2]];
+				for (const Vector3* p : { &a, &b, &c })
+				{
+					cluster.bounds_min.makeFloor(*p);
+					cluster.bounds_max.makeCeil(*p);
+				}
+				Vector3 n = (b - a).crossProduct(c - a);
+				if (n.squaredLength() > 0.f)
+					axis += n.normalizedCopy();
+			}
+
+			cluster.center = (cluster.bounds_min + cluster.bounds_max) * 0.5f;
+			cluster.radius = 0.f;
+			for (int i = first * 3; i < (first + (int)cluster.num_faces) * 3; i++)
+				cluster.radius = std::max(cluster.radius, (m_positions[m_indices[i]] - cluster.center).length());
+
+			// the cone opening is the widest angle between the axis and a face normal
+			cluster.cone_axis = Vector3(0.f, 0.f, 0.f);
+			cluster.cone_cutoff = 1.f;
+			if (axis.squaredLength() > Float_EPSILON)
+			{
+				axis.normalise();
+				float min_dot = 1.f;
+				for (int f = first; f < first + (int)cluster.num_faces; f++)
+				{
+					const Vector3& a = m_positions[m_indices[f * 3]];
+					Vector3 n = (m_positions[m_indices[f * 3 + 1]] - a).crossProduct(m_positions[m_indices[f * 3 + 2]] - a);
+					if (n.squaredLength() > 0.f)
+						min_dot = std::min(min_dot, axis.dotProduct(n.normalizedCopy()));
+				}
+				if (min_dot > 0.f)
+				{
+					cluster.cone_axis = axis;
+					cluster.cone_cutoff = std::sqrt(1.f - min_dot * min_dot);
+				}
+			}
+			m_meshlets.push_back(cluster);
 		}
+	}
+
+	void Model::bind_storage()
+	{
+		m_positions = m_storage.positions;
+		m_normals = m_storage.normals;
+		m_texcoords = m_storage.texcoords;
+		m_tangents = m_storage.tangents;
+		m_indices = m_storage.indices;
+	}
 
-		// normal_map
-		texfile = texfile.substr(0, dot) + std::string("_normal.tga");
-		if (_access(texfile.data(), 0) != -1)
+	bool Model::load_cache(const std::string& path, const mesh_source_stamp& stamp)
+	{
+		// the views below point into the mapping, it stays open for the model's lifetime
+		MappedFile& file = m_cache_file;
+		if (!file.open(path))
+			return false;
+		if (file.size() < sizeof(mesh_cache_header))
 		{
-			normal_map = new TGAImage();
-			load_texture(filename, "_normal.tga", normal_map);
+			file.close();
+			return false;
 		}
 
-		// specular_map
-		texfile = texfile.substr(0, dot) + std::string("_spec.tga");
-		if (_access(texfile.data(), 0) != -1)
+		mesh_cache_header header;
+		memcpy(&header, file.data(), sizeof(header));
+		if (memcmp(header.magic, MESH_CACHE_MAGIC, 4) != 0 || header.version != MESH_CACHE_VERSION
+			|| header.source_size != stamp.size || header.source_mtime != stamp.mtime || header.source_hash != stamp.hash
+			|| header.num_indices % 3 != 0)
 		{
-			specular_map = new TGAImage();
-			load_texture(filename, "_spec.tga", specular_map);
+			file.close();
+			return false;
 		}
 
-		// roughness
-		texfile = texfile.substr(0, dot) + std::string("_roughness.tga");
-		if (_access(texfile.data(), 0) != -1)
+		// every array must lie inside the file at an aligned offset
+		auto section_ok = [&file](uint64_t offset, uint64_t count, uint64_t stride)
+		{
+			return offset % MESH_CACHE_ALIGN == 0 && offset <= file.size() && count * stride <= file.size() - offset;
+		};
+		uint64_t nv = header.num_vertices;
+		if (!section_ok(header.positions, nv, sizeof(Vector3)) || !section_ok(header.normals, nv, sizeof(Vector3))
+			|| !section_ok(header.texcoords, nv, sizeof(Vector2)) || !section_ok(header.tangents, nv, sizeof(Vector4))
+			|| !section_ok(header.indices, header.num_indices, sizeof(uint32_t))
+			|| !section_ok(header.submeshes, header.num_submeshes, sizeof(mesh_cache_submesh))
+			|| !section_ok(header.strings, header.strings_size, 1))
 		{
-			roughness_map = new TGAImage();
-			load_texture(filename, "_roughness.tga", roughness_map);
+			file.close();
+			return false;
 		}
 
-		// metalness
-		texfile = texfile.substr(0, dot) + std::string("_metalness.tga");
-		if (_access(texfile.data(), 0) != -1)
+		const uint8_t* base = file.data();
+		m_positions = ArrayView<Vector3>((const Vector3*)(base + header.positions), nv);
+		m_normals = ArrayView<Vector3>((const Vector3*)(base + header.normals), nv);
+		m_texcoords = ArrayView<Vector2>((const Vector2*)(base + header.texcoords), nv);
+		m_tangents = ArrayView<Vector4>((const Vector4*)(base + header.tangents), nv);
+		m_indices = ArrayView<uint32_t>((const uint32_t*)(base + header.indices), header.num_indices);
+		m_bounds_min = Vector3(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]);
+		m_bounds_max = Vector3(header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]);
+
+		// names are copied, they are few and short
+		const char* str = (const char*)(base + header.strings);
+		const char* str_end = str + header.strings_size;
+		auto next_string = [&str, str_end]()
 		{
-			metalness_map = new TGAImage();
-			load_texture(filename, "_metalness.tga", metalness_map);
+			const char* end = std::find(str, str_end, '\0');
+			std::string result(str, end);
+			str = end < str_end ? end + 1 : end;
+			return result;
+		};
+
+		const mesh_cache_submesh* ranges = (const mesh_cache_submesh*)(base + header.submeshes);
+		m_submeshes.resize(header.num_submeshes);
+		for (uint32_t i = 0; i < header.num_submeshes; i++)
+		{
+			m_submeshes[i].first_index = ranges[i].first_index;
+			m_submeshes[i].index_count = ranges[i].index_count;
+			m_submeshes[i].name = next_string();
+			m_submeshes[i].material = next_string();
 		}
+		m_material_libs.resize(header.num_material_libs);
+		for (auto& lib : m_material_libs)
+			lib = next_string();
 
-		// emission
-		texfile = texfile.substr(0, dot) + std::string("_emission.tga");
-		if (_access(texfile.data(), 0) != -1)
+		return true;
+	}
+
+	bool Model::write_cache(const std::string& path, const mesh_source_stamp& stamp) const
+	{
+		mesh_cache_header header;
+		memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+		header.version = MESH_CACHE_VERSION;
+		header.source_size = stamp.size;
+		header.source_mtime = stamp.mtime;
+		header.source_hash = stamp.hash;
+		header.num_vertices = (uint32_t)m_positions.size();
+		header.num_indices = (uint32_t)m_indices.size();
+		for (int i = 0; i < 3; i++)
+		{
+			header.bounds_min[i] = m_bounds_min[i];
+			header.bounds_max[i] = m_bounds_max[i];
+		}
+
+		uint64_t nv = m_positions.size();
+		header.positions = align_offset(sizeof(header));
+		header.normals = align_offset(header.positions + nv * sizeof(Vector3));
+		header.texcoords = align_offset(header.normals + nv * sizeof(Vector3));
+		header.tangents = align_offset(header.texcoords + nv * sizeof(Vector2));
+		header.indices = align_offset(header.tangents + nv * sizeof(Vector4));
+
+		std::vector<mesh_cache_submesh> ranges;
+		std::string strings;
+		for (const auto& submesh : m_submeshes)
+		{
+			ranges.push_back({ submesh.first_index, submesh.index_count });
+			strings += submesh.name;
+			strings += '\0';
+			strings += submesh.material;
+			strings += '\0';
+		}
+		for (const auto& lib : m_material_libs)
+		{
+			strings += lib;
+			strings += '\0';
+		}
+		header.num_submeshes = (uint32_t)ranges.size();
+		header.num_material_libs = (uint32_t)m_material_libs.size();
+		header.submeshes = align_offset(header.indices + m_indices.size() * sizeof(uint32_t));
+		header.strings = align_offset(header.submeshes + ranges.size() * sizeof(mesh_cache_submesh));
+		header.strings_size = strings.size();
+
+		// written under a temporary name and renamed, readers never see a partial file
+		std::string temp_path = path + ".tmp";
+		{
+			std::ofstream out(temp_path, std::ofstream::binary | std::ofstream::trunc);
+			if (out.fail())
+				return false;
+
+			mesh_cache_header blank = {};
+			out.write((const char*)&blank, sizeof(blank));
+
+			auto write_section = [&out](uint64_t offset, const void* data, uint64_t bytes)
+			{
+				static const char zeros[MESH_CACHE_ALIGN] = {};
+				uint64_t pos = (uint64_t)out.tellp();
+				out.write(zeros, (std::streamsize)(offset - pos));
+				out.write((const char*)data, (std::streamsize)bytes);
+			};
+			write_section(header.positions, m_positions.data(), nv * sizeof(Vector3));
+			write_section(header.normals, m_normals.data(), nv * sizeof(Vector3));
+			write_section(header.texcoords, m_texcoords.data(), nv * sizeof(Vector2));
+			write_section(header.tangents, m_tangents.data(), nv * sizeof(Vector4));
+			write_section(header.indices, m_indices.data(), m_indices.size() * sizeof(uint32_t));
+			write_section(header.submeshes, ranges.data(), ranges.size() * sizeof(mesh_cache_submesh));
+			write_section(header.strings, strings.data(), strings.size());
+
+			out.seekp(0);
+			out.write((const char*)&header, sizeof(header));
+			if (!out.good())
+			{
+				out.close();
+				std::remove(temp_path.c_str());
+				return false;
+			}
+		}
+
+		std::error_code error;
+		std::filesystem::rename(temp_path, path, error);
+		if (error)
+		{
+			std::remove(temp_path.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	void Model::create_map(const char* filename)
+	{
+		load_map_async(MaterialMap::Diffuse, filename, "_diffuse.tga");
+		load_map_async(MaterialMap::Normal, filename, "_normal.tga");
+		load_map_async(MaterialMap::Specular, filename, "_spec.tga", TextureFormat::R8);
+		load_map_async(MaterialMap::Emission, filename, "_emission.tga");
+
+		std::string path(filename);
+		m_map_loads[(int)MaterialMap::ORM] = loader_pool().submit([this, path]()
+		{
+			// keyed by the model, the three sources sit next to it
+			Texture2D::Ptr map = ResourceManager::getInstance().texture("orm:" + ResourceManager::canonical_path(path),
+				[this, &path]() { return load_orm(path); });
+			m_maps[(int)MaterialMap::ORM].store(map.get(), std::memory_order_release);
+			return map;
+		}).share();
+	}
+
+	// "<model>_diffuse.tga" etc., decoded and mipmapped on the loader pool, shared with other models using the file
+	void Model::load_map_async(MaterialMap slot, const std::string& filename, const char* suffix, TextureFormat format)
+	{
+		size_t dot = filename.find_last_of(".");
+		std::string texfile = dot == std::string::npos ? std::string() : filename.substr(0, dot) + suffix;
+		if (texfile.empty() || !file_exists(texfile))
+			return;
+
+		m_map_loads[(int)slot] = loader_pool().submit([this, slot, texfile, format]()
+		{
+			Texture2D::Ptr map = ResourceManager::getInstance().texture(texfile, format);
+			m_maps[(int)slot].store(map.get(), std::memory_order_release);
+			return map;
+		}).share();
+	}
+
+	bool Model::map_ready(MaterialMap slot) const
+	{
+		const std::shared_future<Texture2D::Ptr>& load = m_map_loads[(int)slot];
+		return !load.valid() || load.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}
+
+	void Model::wait_all() const
+	{
+		for (const auto& load : m_map_loads)
+			if (load.valid())
+				load.wait();
+	}
+
+	// red (or gray) channel of a TGA at uv, bilinear with clamped edges, used to resample at load time
+	static float red_bilinear(TGAImage& image, float u, float v)
+	{
+		int w = image.get_width(), h = image.get_height(), bpp = image.get_bytespp();
+		const unsigned char* data = image.buffer();
+		int channel = bpp == TGAImage::GRAYSCALE ? 0 : 2;
+
+		float x = std::min(std::max(u * w - 0.5f, 0.f), (float)(w - 1));
+		float y = std::min(std::max(v * h - 0.5f, 0.f), (float)(h - 1));
+		int x0 = (int)x, y0 = (int)y;
+		int x1 = std::min(x0 + 1, w - 1), y1 = std::min(y0 + 1, h - 1);
+		float tx = x - x0, ty = y - y0;
+
+		auto texel = [&](int px, int py) { return (float)data[((size_t)py * w + px) * bpp + channel]; };
+		float top = texel(x0, y0) + (texel(x1, y0) - texel(x0, y0)) * tx;
+		float bottom = texel(x0, y1) + (texel(x1, y1) - texel(x0, y1)) * tx;
+		return top + (bottom - top) * ty;
+	}
+
+	/*
+	*  "_occlusion", "_roughness" and "_metalness" packed into the r, g, b channels of one texture
+	*     sized to the largest of the three, smaller maps are resampled bilinearly,
+	*     a missing map is filled with its default (occlusion 1, roughness 1, metalness 0)
+	*/
+	Texture2D::Ptr Model::load_orm(const std::string& filename)
+	{
+		const char* suffixes[3] = { "_occlusion.tga", "_roughness.tga", "_metalness.tga" };
+		const uint8_t defaults[3] = { 255, 255, 0 };
+
+		size_t dot = filename.find_last_of(".");
+		if (dot == std::string::npos)
+			return nullptr;
+
+		TGAImage maps[3];
+		bool found[3] = { false, false, false };
+		int width = 0, height = 0;
+		for (int i = 0; i < 3; i++)
 		{
-			emision_map = new TGAImage();
-			load_texture(filename, "_emission.tga", emision_map);
+			if (!file_exists(filename.substr(0, dot) + suffixes[i]))
+				continue;
+			load_texture(filename, suffixes[i], maps[i]);
+			found[i] = maps[i].buffer() && maps[i].get_width() > 0 && maps[i].get_height() > 0;
+			if (found[i])
+			{
+				width = std::max(width, maps[i].get_width());
+				height = std::max(height, maps[i].get_height());
+			}
 		}
+		if (!found[0] && !found[1] && !found[2])
+			return nullptr;
 
-		// occlusion
-		texfile = texfile.substr(0, dot) + std::string("_occlusion.tga");
-		if (_access(texfile.data(), 0) != -1)
+		std::vector<uint8_t> rgba((size_t)width * height * 4, 255);
+		for (int i = 0; i < 3; i++)
 		{
-			occlusion_map = new TGAImage();
-			load_texture(filename, "_occlusion.tga", occlusion_map);
+			bool same_size = found[i] && maps[i].get_width() == width && maps[i].get_height() == height;
+			int bpp = maps[i].get_bytespp();
+			int channel = bpp == TGAImage::GRAYSCALE ? 0 : 2;
+
+			for (int y = 0; y < height; y++)
+			{
+				for (int x = 0; x < width; x++)
+				{
+					uint8_t value = defaults[i];
+					if (same_size)
+						value = maps[i].buffer()[((size_t)y * width + x) * bpp + channel];
+					else if (found[i])
+						value = (uint8_t)(red_bilinear(maps[i], (x + 0.5f) / width, (y + 0.5f) / height) + 0.5f);
+					rgba[((size_t)y * width + x) * 4 + i] = value;
+				}
+			}
 		}
+
+		return std::make_shared<Texture2D>(width, height, rgba.data());
 	}
 
+	/*
+	*  the six faces are decoded concurrently and shared with other skyboxes using the same files,
+	*  the skybox is only drawable once all of them are in
+	*     a face is "<name>_right.hdr" (float radiance), else "m0_px.hdr" next to it (cmgen's naming
+	*     of the base level), else "<name>_right.tga"
+	*/
 	void Model::load_cubemap(const char* filename)
 	{
-		environment_map->faces[0] = new TGAImage();
-		load_texture(filename, "_right.tga", environment_map->faces[0]);
-		environment_map->faces[1] = new TGAImage();
-		load_texture(filename, "_left.tga", environment_map->faces[1]);
-		environment_map->faces[2] = new TGAImage();
-		load_texture(filename, "_top.tga", environment_map->faces[2]);
-		environment_map->faces[3] = new TGAImage();
-		load_texture(filename, "_bottom.tga", environment_map->faces[3]);
-		environment_map->faces[4] = new TGAImage();
-		load_texture(filename, "_back.tga", environment_map->faces[4]);
-		environment_map->faces[5] = new TGAImage();
-		load_texture(filename, "_front.tga", environment_map->faces[5]);
+		const char* suffixes[6] = { "_right", "_left", "_top", "_bottom", "_back", "_front" };
+		const char* cmgen_faces[6] = { "px", "nx", "py", "ny", "pz", "nz" };
+
+		std::string path(filename);
+		std::string base = path.substr(0, path.find_last_of("."));
+		std::string dir = std::filesystem::path(path).parent_path().string();
+		if (!dir.empty())
+			dir += "/";
+
+		std::future<Texture2D::Ptr> faces[6];
+		for (int i = 0; i < 6; i++)
+		{
+			std::string candidates[3] = { base + suffixes[i] + ".hdr", dir + "m0_" + cmgen_faces[i] + ".hdr", base + suffixes[i] + ".tga" };
+			std::string texfile = candidates[2];
+			for (const std::string& candidate : candidates)
+			{
+				std::error_code error;
+				if (std::filesystem::exists(candidate, error))
+				{
+					texfile = candidate;
+					break;
+				}
+			}
+			faces[i] = loader_pool().submit([texfile]() { return ResourceManager::getInstance().texture(texfile); });
+		}
+		for (int i = 0; i < 6; i++)
+		{
+			environment_map->faces[i] = faces[i].get();
+			// a missing face samples as black
+			if (!environment_map->faces[i])
+			{
+				static const uint8_t black[4] = { 0, 0, 0, 255 };
+				environment_map->faces[i] = std::make_shared<Texture2D>(1, 1, black);
+			}
+		}
+	}
+
+	size_t Model::memory_size() const
+	{
+		return m_positions.size() * sizeof(Vector3) + m_normals.size() * sizeof(Vector3) + m_texcoords.size() * sizeof(Vector2)
+			+ m_tangents.size() * sizeof(Vector4) + m_indices.size() * sizeof(uint32_t) + m_meshlets.size() * sizeof(meshlet);
 	}
 
 	int Model::nverts() const
 	{
-		return m_verts.size();
+		return (int)m_positions.size();
 	}
 
 	int Model::nfaces() const
 	{
-		return m_faces.size();
+		return (int)(m_indices.size() / 3);
 	}
 
 	std::vector<int> Model::face(int idx)
 	{
 		std::vector<int> f;
 		for (int i = 0; i < 3; i++)
-			f.push_back(m_faces[idx][i * 3]);
+			f.push_back((int)m_indices[idx * 3 + i]);
 		return f;
 	}
 
 	Vector3 Model::vert(int i)
 	{
-		return m_verts[i];
+		return m_positions[i];
 	}
 
-	// face -> [vert, norm, uv, vert, norm, uv, vert, norm, uv]
+	// face -> 3 indices into the welded vertex arrays
 	Vector3 Model::vert(int iface, int nthvert)
 	{
-		return m_verts[m_faces[iface][nthvert*3]];
+		return m_positions[m_indices[iface * 3 + nthvert]];
 	}
 
 	Vector2 Model::uv(int iface, int nthvert)
 	{
-		return m_uvs[m_faces[iface][nthvert * 3 + 1]];
+		return m_texcoords[m_indices[iface * 3 + nthvert]];
 	}
 
 	Vector3 Model::normal(int iface, int nthvert)
 	{
-		return m_norms[m_faces[iface][nthvert * 3 + 2]];
+		return m_normals[m_indices[iface * 3 + nthvert]];
 	}
 
-	void Model::load_texture(std::string filename, const char* suffix, TGAImage* img)
+	Vector4 Model::tangent(int iface, int nthvert)
 	{
-		std::string texfile(filename);
-		size_t dot = texfile.find_last_of(".");
-		if (dot != std::string::npos)
-		{
-			texfile = texfile.substr(0, dot) + std::string(suffix);
-			img->read_tga_file(texfile.c_str());
-			img->flip_vertically();
-		}
+		return m_tangents[m_indices[iface * 3 + nthvert]];
 	}
 
 	void Model::load_texture(std::string filename, const char* suffix, TGAImage& img)
@@ -238,87 +707,62 @@ namespace OEngine
 		if (dot != std::string::npos)
 		{
 			texfile = texfile.substr(0, dot) + std::string(suffix);
-			img.read_tga_file(texfile.c_str());
-			img.flip_vertically();
+			img.read_tga_file(texfile.c_str(), true);
 		}
 	}
 
-	Vector3 Model::diffuse(Vector2 uv)
+	Vector3 Model::diffuse(Vector2 uv, const Vector4& duv)
 	{
-		uv[0] = fmod(uv[0], 1);
-		uv[1] = fmod(uv[1], 1);
-		int uv0 = uv[0] * diffuse_map->get_width();
-		int uv1 = uv[1] * diffuse_map->get_height();
-		TGAColor c = diffuse_map->get(uv0, uv1);
-		Vector3 res;
-		for (int i = 0; i < 3; i++)
-			res[2 - i] = (float)c[i] / 255.f;
-		return res;
+		const Texture2D* diffuse_map = map(MaterialMap::Diffuse);
+		if (!diffuse_map)
+			return Vector3(1.f, 1.f, 1.f);
+		return diffuse_map->sample(uv, duv).to_vec3();
 	}
 
-	Vector3 Model::normal(Vector2 uv)
+	Vector3 Model::normal(Vector2 uv, const Vector4& duv)
 	{
-		uv[0] = fmod(uv[0], 1);
-		uv[1] = fmod(uv[1], 1);
-		int uv0 = uv[0] * normal_map->get_width();
-		int uv1 = uv[1] * normal_map->get_height();
-		TGAColor c = normal_map->get(uv0, uv1);
-		Vector3 res;
-		for (int i = 0; i < 3; i++)
-			res[2 - i] = (float)c[i] / 255.f * 2.f - 1.f;
-		return res;
+		const Texture2D* normal_map = map(MaterialMap::Normal);
+		if (!normal_map)
+			return Vector3(0.f, 0.f, 1.f);
+		return normal_map->sample(uv, duv).to_vec3() * 2.f - Vector3(1.f, 1.f, 1.f);
 	}
 
-	float Model::roughness(Vector2 uv)
+	Vector3 Model::orm(Vector2 uv, const Vector4& duv)
 	{
-		uv[0] = fmod(uv[0], 1);
-		uv[1] = fmod(uv[1], 1);
-		int uv0 = uv[0] * roughness_map->get_width();
-		int uv1 = uv[1] * roughness_map->get_height();
-		return roughness_map->get(uv0, uv1)[0] / 255.f;
+		const Texture2D* orm_map = map(MaterialMap::ORM);
+		if (!orm_map)
+			return Vector3(1.f, 1.f, 0.f);
+		return orm_map->sample(uv, duv).to_vec3();
 	}
 
-	float Model::metalness(Vector2 uv)
+	float Model::roughness(Vector2 uv, const Vector4& duv)
 	{
-		uv[0] = fmod(uv[0], 1);
-		uv[1] = fmod(uv[1], 1);
-		int uv0 = uv[0] * metalness_map->get_width();
-		int uv1 = uv[1] * metalness_map->get_height();
-		return metalness_map->get(uv0, uv1)[0] / 255.f;
+		return orm(uv, duv).y;
 	}
 
-	float Model::specular(Vector2 uv)
+	float Model::metalness(Vector2 uv, const Vector4& duv)
 	{
-		uv[0] = fmod(uv[0], 1);
-		uv[1] = fmod(uv[1], 1);
-		int uv0 = uv[0] * specular_map->get_width();
-		int uv1 = uv[1] * specular_map->get_height();
-		return specular_map->get(uv0, uv1)[0] / 1.f;
+		return orm(uv, duv).z;
 	}
 
-	float Model::occlusion(Vector2 uv)
+	float Model::specular(Vector2 uv, const Vector4& duv)
 	{
-		if (!occlusion_map)
-			return 1;
-		uv[0] = fmod(uv[0], 1);
-		uv[1] = fmod(uv[1], 1);
-		int uv0 = uv[0] * occlusion_map->get_width();
-		int uv1 = uv[1] * occlusion_map->get_height();
-		return occlusion_map->get(uv0, uv1)[0] / 255.f;
+		const Texture2D* specular_map = map(MaterialMap::Specular);
+		if (!specular_map)
+			return 0.f;
+		return specular_map->sample(uv, duv).x * 255.f;
 	}
 
-	Vector3 Model::emission(Vector2 uv)
+	float Model::occlusion(Vector2 uv, const Vector4& duv)
 	{
+		return orm(uv, duv).x;
+	}
+
+	Vector3 Model::emission(Vector2 uv, const Vector4& duv)
+	{
+		const Texture2D* emision_map = map(MaterialMap::Emission);
 		if (!emision_map)
 			return Vector3(0.f, 0.f, 0.f);
-		uv[0] = fmod(uv[0], 1);
-		uv[1] = fmod(uv[1], 1);
-		int uv0 = uv[0] * emision_map->get_width();
-		int uv1 = uv[1] * emision_map->get_height();
-		TGAColor c = emision_map->get(uv0, uv1);
-		Vector3 res;
-		for (int i = 0; i < 3; i++)
-			res[2 - i] = (float)c[i] / 255.f;
-		return res;
+		return emision_map->sample(uv, duv).to_vec3();
 	}
 } // OEngine
\ No newline at end of file
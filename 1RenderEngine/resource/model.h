@@ -3,62 +3,205 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <cstdint>
+#include <atomic>
+#include <future>
 
 #include "../core/math/math_headers.h"
+#include "../core/base/array_view.h"
+#include "../core/base/mapped_file.h"
 #include "../resource/tgaimage.h"
+#include "../resource/texture2d.h"
+#include "../resource/obj_parser.h"
 
 namespace OEngine
 {
+	// faces +x, -x, +y, -y, +z, -z : RGBA8 from TGA files, RGB32F from .hdr files or baked maps
 	typedef struct cubemap
 	{
-		TGAImage* faces[6];
+		Texture2D::Ptr faces[6];
 	} cubemap_t;
 
+	// identity of the OBJ a mesh cache was built from
+	struct mesh_source_stamp
+	{
+		uint64_t size = 0;
+		int64_t mtime = 0;
+		uint64_t hash = 0;
+	};
+
+	// material maps of a model, "<model>_diffuse.tga" etc.
+	enum class MaterialMap
+	{
+		Diffuse,
+		Normal,
+		Specular,
+		Emission,
+		ORM,		// "_occlusion", "_roughness" and "_metalness" packed into r, g, b
+		Count
+	};
+
+	/*
+	*  cluster of consecutive faces, the unit the rasterizer culls before any vertex work
+	*     bounds_* : object space box of its corners, center / radius : sphere around them
+	*     cone     : every face normal is within the cone around cone_axis, the cluster is back facing
+	*                from eye when dot(center - eye, cone_axis) > cone_cutoff * |center - eye| + radius,
+	*                cone_cutoff is 1 (never back facing) when the normals spread over a half space
+	*/
+	struct meshlet
+	{
+		uint32_t first_face;
+		uint32_t num_faces;
+		Vector3 bounds_min, bounds_max;
+		Vector3 center;
+		float radius;
+		Vector3 cone_axis;
+		float cone_cutoff;
+	};
+
+	struct mesh_load_stats
+	{
+		uint64_t source_bytes = 0;		// size of the OBJ
+		double load_ms = 0;				// geometry and materials, textures excluded
+		bool from_cache = false;		// false : the OBJ was parsed
+	};
+
 	class Model
 	{
 		friend class Rasterizer;
 	private:
-		std::vector<Vector3> m_verts;
-		std::vector<std::vector<int> > m_faces; // vertex/uv/normal
-		std::vector<Vector3> m_norms;
-		std::vector<Vector2> m_uvs;
+		/*
+		*  welded mesh : one vertex per unique OBJ v/vt/vn triplet, attributes in separate arrays,
+		*  polygons fan triangulated into a flat index buffer (3 indices per face)
+		*     the arrays view either m_storage (parsed from the OBJ) or the mapped mesh cache
+		*/
+		ArrayView<Vector3>	m_positions;
+		ArrayView<Vector3>	m_normals;
+		ArrayView<Vector2>	m_texcoords;
+		ArrayView<Vector4>	m_tangents;		// xyz : tangent along +u, w : bitangent sign
+		ArrayView<uint32_t>	m_indices;
+		Vector3 m_bounds_min, m_bounds_max;
+		Vector3 m_bounds_center;
+		float m_bounds_radius = 0.f;
+		std::vector<meshlet> m_meshlets;
+
+		struct mesh_storage
+		{
+			std::vector<Vector3>	positions;
+			std::vector<Vector3>	normals;
+			std::vector<Vector2>	texcoords;
+			std::vector<Vector4>	tangents;
+			std::vector<uint32_t>	indices;
+		} m_storage;
+		MappedFile m_cache_file;
+
+		std::vector<obj_submesh>	m_submeshes;
+		std::vector<std::string>	m_material_libs;
+		std::vector<obj_material>	m_materials;
+		mesh_load_stats				m_load_stats;
+
+		static bool s_mesh_cache;
+
+		bool load_obj(const char* filename);
+		void load_materials(const char* filename);
+		void generate_tangents();
+		void compute_bounds();
+		// bounding sphere and meshlets, rebuilt on every load, they are not part of the mesh cache
+		void build_meshlets();
+		void bind_storage();
+
+		/*
+		*  binary mesh cache, "<model>.omesh" next to the OBJ
+		*     holds the welded arrays, tangents and bounds, loaded with a single mmap
+		*     rebuilt whenever the OBJ's size, mtime or content hash differs from the recorded one
+		*/
+		bool load_cache(const std::string& path, const mesh_source_stamp& stamp);
+		bool write_cache(const std::string& path, const mesh_source_stamp& stamp) const;
+
+		/*
+		*  material maps are decoded on the loader pool, the model is drawable as soon as its
+		*  geometry is loaded : until a map is ready its lookups return the map's default
+		*     m_map_loads : one future per map, empty when the model has no such map
+		*     m_maps	  : published by the loader once the map (and its mips) is complete
+		*/
+		std::shared_future<Texture2D::Ptr>	m_map_loads[(int)MaterialMap::Count];
+		std::atomic<const Texture2D*>		m_maps[(int)MaterialMap::Count];
 
 		void load_cubemap(const char* filename);
 		void create_map(const char* filename);
-		void load_texture(std::string filename, const char* suffix, TGAImage* img);
+		void load_map_async(MaterialMap slot, const std::string& filename, const char* suffix, TextureFormat format = TextureFormat::RGBA8);
+		Texture2D::Ptr load_orm(const std::string& filename);
 		void load_texture(std::string filename, const char* suffix, TGAImage& img);
 
 	public:
 		typedef std::shared_ptr<Model> Ptr;
 
+		static const int MESHLET_FACES = 128;
+
 		Model(const char* filename, int is_skybox = 0);
 		~Model();
 		
-		cubemap_t* environment_map;
+		cubemap_t* environment_map = NULL;
 		int is_skybox;
 
-		TGAImage* diffuse_map;
-		TGAImage* normal_map;
-		TGAImage* specular_map;
-		TGAImage* roughness_map;
-		TGAImage* metalness_map;
-		TGAImage* occlusion_map;
-		TGAImage* emision_map;
+		// the map if it has finished loading, null while loading or when the model has none
+		const Texture2D* map(MaterialMap slot) const { return m_maps[(int)slot].load(std::memory_order_acquire); }
+		// false while the map is still being decoded
+		bool map_ready(MaterialMap slot) const;
+		// blocks until every map has been loaded
+		void wait_all() const;
 
 		int nverts() const;
 		int nfaces() const;
 		Vector3 normal(int iface, int nthvert);
-		Vector3 normal(Vector2 uv);
+		Vector3 normal(Vector2 uv, const Vector4& duv = Vector4(0.f));
 		Vector3 vert(int i);
 		Vector3 vert(int iface, int nthvert);
+		Vector4 tangent(int iface, int nthvert);
 
 		Vector2 uv(int iface, int nthvert);
-		Vector3 diffuse(Vector2 uv);
-		float roughness(Vector2 uv);
-		float metalness(Vector2 uv);
-		float specular(Vector2 uv);
-		float occlusion(Vector2 uv);
-		Vector3 emission(Vector2 uv);
+
+		// index of a face corner into the vertex arrays below
+		uint32_t index(int iface, int nthvert) const { return m_indices[iface * 3 + nthvert]; }
+
+		const ArrayView<Vector3>&	positions() const { return m_positions; }
+		const ArrayView<Vector3>&	normals() const { return m_normals; }
+		const ArrayView<Vector2>&	texcoords() const { return m_texcoords; }
+		const ArrayView<Vector4>&	tangents() const { return m_tangents; }
+		const ArrayView<uint32_t>&	indices() const { return m_indices; }
+
+		// object space axis aligned bounding box
+		const Vector3& bounds_min() const { return m_bounds_min; }
+		const Vector3& bounds_max() const { return m_bounds_max; }
+		// object space bounding sphere
+		const Vector3& bounds_center() const { return m_bounds_center; }
+		float bounds_radius() const { return m_bounds_radius; }
+		// MESHLET_FACES faces each in index order, the last one may be smaller
+		const std::vector<meshlet>& meshlets() const { return m_meshlets; }
+
+		// faces grouped by "o" / "g" / "usemtl", and the materials of the OBJ's mtllibs
+		const std::vector<obj_submesh>& submeshes() const { return m_submeshes; }
+		const std::vector<obj_material>& materials() const { return m_materials; }
+
+		const mesh_load_stats& load_stats() const { return m_load_stats; }
+		// bytes of vertex and index data, textures are accounted for separately
+		size_t memory_size() const;
+
+		// the binary mesh cache is read and written by default
+		static void set_mesh_cache(bool enabled) { s_mesh_cache = enabled; }
+
+		/*
+		*  material lookups, trilinear with the LOD taken from duv (du/dx, dv/dx, du/dy, dv/dy),
+		*  zero derivatives sample the full resolution level bilinearly
+		*/
+		Vector3 diffuse(Vector2 uv, const Vector4& duv = Vector4(0.f));
+		// (occlusion, roughness, metalness) in one fetch, prefer it over the three lookups below
+		Vector3 orm(Vector2 uv, const Vector4& duv = Vector4(0.f));
+		float roughness(Vector2 uv, const Vector4& duv = Vector4(0.f));
+		float metalness(Vector2 uv, const Vector4& duv = Vector4(0.f));
+		float specular(Vector2 uv, const Vector4& duv = Vector4(0.f));
+		float occlusion(Vector2 uv, const Vector4& duv = Vector4(0.f));
+		Vector3 emission(Vector2 uv, const Vector4& duv = Vector4(0.f));
 
 		std::vector<int> face(int idx);
 	};
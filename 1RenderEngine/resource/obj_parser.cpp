@@ -0,0 +1,714 @@
+#include "./obj_parser.h"
+#include "../core/base/mapped_file.h"
+#include "../core/base/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+namespace OEngine
+{
+	/*
+	*  number scanners, independent of the C locale
+	*     floats are assembled from a 64 bit mantissa and an exact power of ten, the common
+	*     OBJ forms ("-0.123456", "1.5e-3") round the same way strtof does
+	*/
+	static inline bool is_blank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	static inline const char* skip_blanks(const char* p, const char* end)
+	{
+		while (p < end && is_blank(*p))
+			p++;
+		return p;
+	}
+
+	static const double POW10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	static const char* scan_float(const char* p, const char* end, float& out)
+	{
+		p = skip_blanks(p, end);
+		const char* start = p;
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		uint64_t mantissa = 0;
+		int exponent = 0;
+		int digits = 0;
+		bool any_digit = false;
+
+		for (; p < end && (unsigned)(*p - '0') < 10; p++, any_digit = true)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+			}
+			else
+				exponent++;
+		}
+		if (p < end && *p == '.')
+		{
+			for (p++; p < end && (unsigned)(*p - '0') < 10; p++, any_digit = true)
+			{
+				if (digits < 19)
+				{
+					mantissa = mantissa * 10 + (*p - '0');
+					digits += mantissa != 0;
+					exponent--;
+				}
+			}
+		}
+		if (!any_digit)
+		{
+			// "nan", "inf" and friends, rare enough for the slow path
+			char* strtod_end;
+			std::string token(start, std::find_if(start, end, [](char c) { return is_blank(c) || c == '\n'; }));
+			double value = strtod(token.c_str(), &strtod_end);
+			if (strtod_end == token.c_str())
+				return nullptr;
+			out = (float)value;
+			return start + (strtod_end - token.c_str());
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			const char* q = p + 1;
+			bool exp_negative = false;
+			if (q < end && (*q == '-' || *q == '+'))
+				exp_negative = *q++ == '-';
+			if (q < end && (unsigned)(*q - '0') < 10)
+			{
+				int e = 0;
+				for (; q < end && (unsigned)(*q - '0') < 10; q++)
+					e = std::min(e * 10 + (*q - '0'), 100000);
+				exponent += exp_negative ? -e : e;
+				p = q;
+			}
+		}
+
+		double value = (double)mantissa;
+		if (exponent >= 0)
+			value = exponent <= 22 ? value * POW10[exponent] : value * std::pow(10.0, exponent);
+		else
+			value = exponent >= -22 ? value / POW10[-exponent] : value * std::pow(10.0, exponent);
+
+		out = (float)(negative ? -value : value);
+		return p;
+	}
+
+	static const char* scan_int(const char* p, const char* end, long& out)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		const char* digits = p;
+		long value = 0;
+		for (; p < end && (unsigned)(*p - '0') < 10; p++)
+			value = value * 10 + (*p - '0');
+		if (p == digits)
+			return nullptr;
+
+		out = negative ? -value : value;
+		return p;
+	}
+
+	// rest of the line without the surrounding blanks
+	static std::string line_tail(const char* p, const char* end)
+	{
+		p = skip_blanks(p, end);
+		while (end > p && is_blank(end[-1]))
+			end--;
+		return std::string(p, end);
+	}
+
+	static bool keyword(const char* p, const char* end, const char* word, const char*& after)
+	{
+		size_t len = strlen(word);
+		if ((size_t)(end - p) < len || memcmp(p, word, len) != 0)
+			return false;
+		if (p + len < end && !is_blank(p[len]))
+			return false;
+		after = p + len;
+		return true;
+	}
+
+	/*
+	*  one face corner as written in the file
+	*     absolute indices are stored 0-based, relative (negative) ones are stored as an index into
+	*     the chunk's own arrays and flagged, the merge adds the chunk's base, -1 : missing
+	*/
+	struct obj_corner
+	{
+		int32_t v, vt, vn;
+		uint8_t relative;	// bit 0 : v, bit 1 : vt, bit 2 : vn
+	};
+
+	enum class obj_event_type
+	{
+		Object,			// "o" / "g"
+		Material,		// "usemtl"
+		Library			// "mtllib"
+	};
+
+	struct obj_event
+	{
+		obj_event_type type;
+		std::string text;
+		uint32_t face;		// number of the chunk's faces read before the event
+	};
+
+	struct obj_chunk
+	{
+		std::vector<Vector3>		v;
+		std::vector<Vector3>		vn;
+		std::vector<Vector2>		vt;
+		std::vector<obj_corner>		corners;
+		std::vector<uint32_t>		face_sizes;
+		std::vector<obj_event>		events;
+	};
+
+	static void parse_corner_index(long raw, int local_count, int bit, int32_t& index, uint8_t& relative)
+	{
+		if (raw > 0)
+			index = (int32_t)(raw - 1);
+		else if (raw < 0)
+		{
+			index = (int32_t)(local_count + raw);
+			relative |= bit;
+		}
+		else
+			index = -1;
+	}
+
+	static void parse_chunk(const char* p, const char* end, obj_chunk& chunk)
+	{
+		// a rough guess from the chunk size, keeps the vectors from regrowing
+		size_t lines = (end - p) / 32;
+		chunk.v.reserve(lines / 4);
+		chunk.corners.reserve(lines);
+
+		while (p < end)
+		{
+			const char* line_end = (const char*)memchr(p, '\n', end - p);
+			if (!line_end)
+				line_end = end;
+
+			const char* s = skip_blanks(p, line_end);
+			const char* rest;
+
+			if (s + 1 < line_end && s[0] == 'v' && is_blank(s[1]))
+			{
+				Vector3 v;
+				const char* q = s + 1;
+				for (int i = 0; i < 3 && q; i++)
+					q = scan_float(q, line_end, v[i]);
+				chunk.v.push_back(v);
+			}
+			else if (s + 2 < line_end && s[0] == 'v' && s[1] == 't' && is_blank(s[2]))
+			{
+				Vector2 uv;
+				const char* q = s + 2;
+				for (int i = 0; i < 2 && q; i++)
+					q = scan_float(q, line_end, uv[i]);
+				chunk.vt.push_back(uv);
+			}
+			else if (s + 2 < line_end && s[0] == 'v' && s[1] == 'n' && is_blank(s[2]))
+			{
+				Vector3 n;
+				const char* q = s + 2;
+				for (int i = 0; i < 3 && q; i++)
+					q = scan_float(q, line_end, n[i]);
+				chunk.vn.push_back(n);
+			}
+			else if (s + 1 < line_end && s[0] == 'f' && is_blank(s[1]))
+			{
+				uint32_t count = 0;
+				const char* q = s + 1;
+				for (;;)
+				{
+					q = skip_blanks(q, line_end);
+					if (q >= line_end)
+						break;
+
+					long raw[3] = { 0, 0, 0 };
+					const char* token = q;
+					for (int k = 0; k < 3; k++)
+					{
+						const char* after = scan_int(q, line_end, raw[k]);
+						if (after)
+							q = after;
+						if (q >= line_end || *q != '/')
+							break;
+						q++;
+					}
+					// skip whatever is left of a malformed token
+					while (q < line_end && !is_blank(*q))
+						q++;
+					if (raw[0] == 0 || q == token)
+						break;
+
+					obj_corner corner;
+					corner.relative = 0;
+					parse_corner_index(raw[0], (int)chunk.v.size(), 1, corner.v, corner.relative);
+					parse_corner_index(raw[1], (int)chunk.vt.size(), 2, corner.vt, corner.relative);
+					parse_corner_index(raw[2], (int)chunk.vn.size(), 4, corner.vn, corner.relative);
+					chunk.corners.push_back(corner);
+					count++;
+				}
+				if (count > 0)
+					chunk.face_sizes.push_back(count);
+			}
+			else if (keyword(s, line_end, "o", rest) || keyword(s, line_end, "g", rest))
+			{
+				chunk.events.push_back({ obj_event_type::Object, line_tail(rest, line_end), (uint32_t)chunk.face_sizes.size() });
+			}
+			else if (keyword(s, line_end, "usemtl", rest))
+			{
+				chunk.events.push_back({ obj_event_type::Material, line_tail(rest, line_end), (uint32_t)chunk.face_sizes.size() });
+			}
+			else if (keyword(s, line_end, "mtllib", rest))
+			{
+				chunk.events.push_back({ obj_event_type::Library, line_tail(rest, line_end), (uint32_t)chunk.face_sizes.size() });
+			}
+
+			p = line_end + 1;
+		}
+	}
+
+	/*
+	*  (v, vt, vn) -> welded vertex
+	*     most positions only ever appear with one uv / normal pair, so the first vertex made from
+	*     each position is looked up directly, the others go to an open addressing table
+	*/
+	class corner_welder
+	{
+	public:
+		explicit corner_welder(size_t num_positions) : m_first(num_positions, NONE)
+		{
+			grow(1024);
+		}
+
+		// welded vertex of the key, next_value when the key is new
+		uint32_t find_or_insert(int32_t v, int32_t vt, int32_t vn, uint32_t next_value, bool& inserted)
+		{
+			inserted = false;
+
+			uint32_t first = m_first[v];
+			if (first == NONE)
+			{
+				m_first[v] = next_value;
+				m_vt.push_back(vt);
+				m_vn.push_back(vn);
+				inserted = true;
+				return next_value;
+			}
+			if (m_vt[first] == vt && m_vn[first] == vn)
+				return first;
+
+			for (size_t i = hash(v, vt, vn) & m_mask;; i = (i + 1) & m_mask)
+			{
+				slot& s = m_slots[i];
+				if (s.v == v && s.vt == vt && s.vn == vn)
+					return s.value;
+				if (s.v == EMPTY)
+					break;
+			}
+
+			if ((m_count + 1) * 2 > m_slots.size())
+				grow(m_slots.size() * 2);
+			insert(slot{ v, vt, vn, next_value });
+			m_count++;
+
+			m_vt.push_back(vt);
+			m_vn.push_back(vn);
+			inserted = true;
+			return next_value;
+		}
+
+	private:
+		static const uint32_t NONE = UINT32_MAX;
+		static const int32_t EMPTY = INT32_MIN;
+
+		struct slot
+		{
+			int32_t v = EMPTY, vt = 0, vn = 0;
+			uint32_t value = 0;
+		};
+
+		static uint64_t hash(int32_t v, int32_t vt, int32_t vn)
+		{
+			uint64_t h = (uint64_t)(uint32_t)v * 0x9E3779B97F4A7C15ULL;
+			h ^= (uint64_t)(uint32_t)vt * 0xC2B2AE3D27D4EB4FULL + (h >> 29);
+			h ^= (uint64_t)(uint32_t)vn * 0x165667B19E3779F9ULL + (h >> 31);
+			return h ^ (h >> 32);
+		}
+
+		void insert(const slot& entry)
+		{
+			size_t i = hash(entry.v, entry.vt, entry.vn) & m_mask;
+			while (m_slots[i].v != EMPTY)
+				i = (i + 1) & m_mask;
+			m_slots[i] = entry;
+		}
+
+		void grow(size_t capacity)
+		{
+			std::vector<slot> old(capacity);
+			old.swap(m_slots);
+			m_mask = capacity - 1;
+			for (const slot& entry : old)
+				if (entry.v != EMPTY)
+					insert(entry);
+		}
+
+		std::vector<uint32_t> m_first;		// per position
+		std::vector<int32_t> m_vt, m_vn;	// per welded vertex
+		std::vector<slot> m_slots;
+		size_t m_mask = 0;
+		size_t m_count = 0;
+	};
+
+	static float cross_2d(const float* a, const float* b, const float* c)
+	{
+		return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+	}
+
+	// points on the border count as inside, a corner touching the diagonal would make the ear overlap
+	static bool point_in_triangle_2d(const float* p, const float* a, const float* b, const float* c, float sign)
+	{
+		return cross_2d(a, b, p) * sign >= 0.f && cross_2d(b, c, p) * sign >= 0.f && cross_2d(c, a, p) * sign >= 0.f;
+	}
+
+	/*
+	*  polygon -> triangles, winding kept
+	*     convex polygons are fanned from the first corner, concave ones are ear clipped in the
+	*     plane of their Newell normal, a degenerate polygon falls back to the fan
+	*/
+	static void triangulate(const uint32_t* vertex, const Vector3* pos, int n, std::vector<uint32_t>& indices)
+	{
+		if (n == 3)
+		{
+			indices.insert(indices.end(), vertex, vertex + 3);
+			return;
+		}
+
+		Vector3 normal(0.f, 0.f, 0.f);
+		for (int i = 0; i < n; i++)
+		{
+			const Vector3& a = pos[i];
+			const Vector3& b = pos[(i + 1) % n];
+			normal.x += (a.y - b.y) * (a.z + b.z);
+			normal.y += (a.z - b.z) * (a.x + b.x);
+			normal.z += (a.x - b.x) * (a.y + b.y);
+		}
+
+		// project on the plane where the polygon is largest
+		int axis = std::fabs(normal.x) > std::fabs(normal.y) ? 0 : 1;
+		if (std::fabs(normal.z) > std::fabs(normal[axis]))
+			axis = 2;
+		int u = (axis + 1) % 3, v = (axis + 2) % 3;
+		float sign = normal[axis] < 0.f ? -1.f : 1.f;
+
+		std::vector<float> p2(n * 2);
+		for (int i = 0; i < n; i++)
+		{
+			p2[i * 2 + 0] = pos[i][u];
+			p2[i * 2 + 1] = pos[i][v];
+		}
+
+		bool convex = normal[axis] != 0.f;
+		for (int i = 0; i < n && convex; i++)
+			convex = cross_2d(&p2[i * 2], &p2[((i + 1) % n) * 2], &p2[((i + 2) % n) * 2]) * sign >= 0.f;
+
+		std::vector<int> remaining(n);
+		for (int i = 0; i < n; i++)
+			remaining[i] = i;
+
+		if (!convex && normal[axis] != 0.f)
+		{
+			int guard = 0;
+			for (size_t i = 0; remaining.size() > 3 && guard < (int)remaining.size(); )
+			{
+				size_t m = remaining.size();
+				int prev = remaining[(i + m - 1) % m], cur = remaining[i % m], next = remaining[(i + 1) % m];
+				const float* a = &p2[prev * 2];
+				const float* b = &p2[cur * 2];
+				const float* c = &p2[next * 2];
+
+				bool ear = cross_2d(a, b, c) * sign > 0.f;
+				for (size_t k = 0; k < m && ear; k++)
+				{
+					int other = remaining[k];
+					if (other != prev && other != cur && other != next)
+						ear = !point_in_triangle_2d(&p2[other * 2], a, b, c, sign);
+				}
+
+				if (ear)
+				{
+					indices.push_back(vertex[prev]);
+					indices.push_back(vertex[cur]);
+					indices.push_back(vertex[next]);
+					remaining.erase(remaining.begin() + i % m);
+					guard = 0;
+				}
+				else
+				{
+					i = (i + 1) % m;
+					guard++;
+				}
+			}
+		}
+
+		for (size_t k = 1; k + 1 < remaining.size(); k++)
+		{
+			indices.push_back(vertex[remaining[0]]);
+			indices.push_back(vertex[remaining[k]]);
+			indices.push_back(vertex[remaining[k + 1]]);
+		}
+	}
+
+	// chunks of at least this many bytes, smaller files are not worth a second thread
+	static const size_t OBJ_CHUNK_BYTES = 1 << 20;
+
+	bool parse_obj(const std::string& path, obj_mesh& mesh, int num_threads)
+	{
+		MappedFile file;
+		if (!file.open(path))
+			return false;
+
+		const char* begin = (const char*)file.data();
+		const char* end = begin + file.size();
+
+		// split at line boundaries, a few chunks per thread so uneven lines still balance
+		int threads = num_threads > 0 ? num_threads : std::max(1, (int)std::thread::hardware_concurrency());
+		size_t num_chunks = std::max<size_t>(1, std::min<size_t>(file.size() / OBJ_CHUNK_BYTES, (size_t)threads * 4));
+
+		std::vector<const char*> bounds(1, begin);
+		for (size_t i = 1; i < num_chunks; i++)
+		{
+			const char* p = std::max(bounds.back(), begin + file.size() * i / num_chunks);
+			const char* newline = (const char*)memchr(p, '\n', end - p);
+			if (!newline)
+				break;
+			bounds.push_back(newline + 1);
+		}
+		bounds.push_back(end);
+		num_chunks = bounds.size() - 1;
+
+		std::vector<obj_chunk> chunks(num_chunks);
+		auto parse = [&chunks, &bounds](int i, int)
+		{
+			parse_chunk(bounds[i], bounds[i + 1], chunks[i]);
+		};
+		if (num_chunks > 1 && threads > 1)
+		{
+			ThreadPool pool(std::min(threads, (int)num_chunks) - 1);
+			pool.parallel_for(0, (int)num_chunks, parse);
+		}
+		else
+			for (size_t i = 0; i < num_chunks; i++)
+				parse((int)i, 0);
+
+		// merge : chunk arrays are concatenated, relative indices get the chunk's base added
+		std::vector<Vector3> verts, norms;
+		std::vector<Vector2> uvs;
+		std::vector<int> base_v(num_chunks), base_vt(num_chunks), base_vn(num_chunks);
+		size_t total_corners = 0;
+		for (size_t c = 0; c < num_chunks; c++)
+		{
+			base_v[c] = (int)verts.size();
+			base_vt[c] = (int)uvs.size();
+			base_vn[c] = (int)norms.size();
+			verts.insert(verts.end(), chunks[c].v.begin(), chunks[c].v.end());
+			uvs.insert(uvs.end(), chunks[c].vt.begin(), chunks[c].vt.end());
+			norms.insert(norms.end(), chunks[c].vn.begin(), chunks[c].vn.end());
+			total_corners += chunks[c].corners.size();
+
+			std::vector<Vector3>().swap(chunks[c].v);
+			std::vector<Vector2>().swap(chunks[c].vt);
+			std::vector<Vector3>().swap(chunks[c].vn);
+		}
+
+		mesh = obj_mesh();
+		mesh.indices.reserve(total_corners);
+		std::vector<uint8_t> has_normal;
+		corner_welder welder(verts.size());
+
+		obj_submesh current;
+		auto close_submesh = [&mesh, &current]()
+		{
+			current.index_count = (uint32_t)mesh.indices.size() - current.first_index;
+			if (current.index_count > 0)
+				mesh.submeshes.push_back(current);
+			current.first_index = (uint32_t)mesh.indices.size();
+		};
+
+		std::vector<uint32_t> polygon;
+		std::vector<Vector3> polygon_pos;
+		for (size_t c = 0; c < num_chunks; c++)
+		{
+			const obj_chunk& chunk = chunks[c];
+			const obj_corner* corner = chunk.corners.data();
+			size_t event = 0;
+
+			for (uint32_t f = 0; f <= chunk.face_sizes.size(); f++)
+			{
+				for (; event < chunk.events.size() && chunk.events[event].face == f; event++)
+				{
+					const obj_event& e = chunk.events[event];
+					if (e.type == obj_event_type::Library)
+					{
+						mesh.material_libs.push_back(e.text);
+						continue;
+					}
+					close_submesh();
+					if (e.type == obj_event_type::Object)
+						current.name = e.text.empty() ? "unnamed" : e.text;
+					else
+						current.material = e.text;
+				}
+				if (f == chunk.face_sizes.size())
+					break;
+
+				uint32_t n = chunk.face_sizes[f];
+				const obj_corner* face = corner;
+				corner += n;
+
+				polygon.clear();
+				polygon_pos.clear();
+				for (uint32_t k = 0; k < n; k++)
+				{
+					int32_t v = face[k].relative & 1 ? base_v[c] + face[k].v : face[k].v;
+					int32_t vt = face[k].relative & 2 ? base_vt[c] + face[k].vt : face[k].vt;
+					int32_t vn = face[k].relative & 4 ? base_vn[c] + face[k].vn : face[k].vn;
+
+					// an unknown position ends the polygon, unknown uvs / normals are dropped
+					if (v < 0 || v >= (int32_t)verts.size())
+						break;
+					if (vt < 0 || vt >= (int32_t)uvs.size())
+						vt = -1;
+					if (vn < 0 || vn >= (int32_t)norms.size())
+						vn = -1;
+
+					bool inserted;
+					uint32_t index = welder.find_or_insert(v, vt, vn, (uint32_t)mesh.positions.size(), inserted);
+					if (inserted)
+					{
+						mesh.positions.push_back(verts[v]);
+						mesh.texcoords.push_back(vt >= 0 ? uvs[vt] : Vector2(0.f, 0.f));
+						mesh.normals.push_back(vn >= 0 ? norms[vn] : Vector3(0.f, 0.f, 0.f));
+						has_normal.push_back(vn >= 0);
+					}
+					polygon.push_back(index);
+					polygon_pos.push_back(verts[v]);
+				}
+
+				if (polygon.size() >= 3)
+					triangulate(polygon.data(), polygon_pos.data(), (int)polygon.size(), mesh.indices);
+			}
+		}
+		close_submesh();
+
+		// vertices without a "vn" get the area weighted normal of their faces
+		if (std::find(has_normal.begin(), has_normal.end(), 0) != has_normal.end())
+		{
+			for (size_t i = 0; i < mesh.indices.size(); i += 3)
+			{
+				uint32_t a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+				Vector3 face_normal = (mesh.positions[b] - mesh.positions[a]).crossProduct(mesh.positions[c] - mesh.positions[a]);
+				for (uint32_t v : { a, b, c })
+					if (!has_normal[v])
+						mesh.normals[v] += face_normal;
+			}
+			for (size_t v = 0; v < mesh.normals.size(); v++)
+				if (!has_normal[v])
+					mesh.normals[v].normalise();
+		}
+
+		return true;
+	}
+
+	bool parse_mtl(const std::string& path, std::vector<obj_material>& materials)
+	{
+		MappedFile file;
+		if (!file.open(path))
+			return false;
+
+		const char* p = (const char*)file.data();
+		const char* end = p + file.size();
+
+		bool listening = false;
+		obj_material material;
+
+		while (p < end)
+		{
+			const char* line_end = (const char*)memchr(p, '\n', end - p);
+			if (!line_end)
+				line_end = end;
+
+			const char* s = skip_blanks(p, line_end);
+			const char* rest;
+
+			if (keyword(s, line_end, "newmtl", rest))
+			{
+				if (listening)
+					materials.push_back(material);
+				listening = true;
+				material = obj_material();
+				material.name = line_tail(rest, line_end);
+				if (material.name.empty())
+					material.name = "none";
+			}
+			else if (keyword(s, line_end, "Ka", rest) || keyword(s, line_end, "Kd", rest) || keyword(s, line_end, "Ks", rest))
+			{
+				Vector3& color = s[1] == 'a' ? material.Ka : s[1] == 'd' ? material.Kd : material.Ks;
+				Vector3 value;
+				const char* q = rest;
+				for (int i = 0; i < 3 && q; i++)
+					q = scan_float(q, line_end, value[i]);
+				if (q)
+					color = value;
+			}
+			else if (keyword(s, line_end, "Ns", rest))
+				scan_float(rest, line_end, material.Ns);
+			else if (keyword(s, line_end, "Ni", rest))
+				scan_float(rest, line_end, material.Ni);
+			else if (keyword(s, line_end, "d", rest))
+				scan_float(rest, line_end, material.d);
+			else if (keyword(s, line_end, "illum", rest))
+			{
+				long illum;
+				if (scan_int(skip_blanks(rest, line_end), line_end, illum))
+					material.illum = (int)illum;
+			}
+			else if (keyword(s, line_end, "map_Ka", rest))
+				material.map_Ka = line_tail(rest, line_end);
+			else if (keyword(s, line_end, "map_Kd", rest))
+				material.map_Kd = line_tail(rest, line_end);
+			else if (keyword(s, line_end, "map_Ks", rest))
+				material.map_Ks = line_tail(rest, line_end);
+			else if (keyword(s, line_end, "map_Ns", rest))
+				material.map_Ns = line_tail(rest, line_end);
+			else if (keyword(s, line_end, "map_d", rest))
+				material.map_d = line_tail(rest, line_end);
+			else if (keyword(s, line_end, "map_Bump", rest) || keyword(s, line_end, "map_bump", rest) || keyword(s, line_end, "bump", rest))
+				material.map_bump = line_tail(rest, line_end);
+
+			p = line_end + 1;
+		}
+
+		materials.push_back(material);
+		return true;
+	}
+} // OEngine
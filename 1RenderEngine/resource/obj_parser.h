@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "../core/math/math_headers.h"
+
+/*
+*  Wavefront OBJ / MTL reader
+*     same semantics as objl::Loader (submeshes split at o / g / usemtl, materials from mtllib,
+*     n-gons triangulated), but the file is read into one buffer, split at line boundaries and
+*     the chunks are parsed concurrently, then merged and welded in file order
+*/
+
+namespace OEngine
+{
+	// one "newmtl" block of a .mtl file, the fields of objl::Material
+	struct obj_material
+	{
+		std::string name;
+		Vector3 Ka;
+		Vector3 Kd;
+		Vector3 Ks;
+		float Ns = 0.f;
+		float Ni = 0.f;
+		float d = 0.f;
+		int illum = 0;
+		std::string map_Ka;
+		std::string map_Kd;
+		std::string map_Ks;
+		std::string map_Ns;
+		std::string map_d;
+		std::string map_bump;
+	};
+
+	// faces between two "o" / "g" / "usemtl" lines : a range of the index buffer
+	struct obj_submesh
+	{
+		std::string name;
+		std::string material;
+		uint32_t first_index = 0;
+		uint32_t index_count = 0;
+	};
+
+	/*
+	*  welded mesh : one vertex per unique v/vt/vn triplet, 3 indices per triangle
+	*     vertices without a "vn" get the area weighted normal of their faces
+	*/
+	struct obj_mesh
+	{
+		std::vector<Vector3>		positions;
+		std::vector<Vector3>		normals;
+		std::vector<Vector2>		texcoords;
+		std::vector<uint32_t>		indices;
+		std::vector<obj_submesh>	submeshes;
+		std::vector<std::string>	material_libs;	// "mtllib" paths, relative to the OBJ
+	};
+
+	// num_threads <= 0 : every hardware thread, small files are always parsed on the calling thread
+	bool parse_obj(const std::string& path, obj_mesh& mesh, int num_threads = 0);
+
+	// appends the materials of a .mtl file
+	bool parse_mtl(const std::string& path, std::vector<obj_material>& materials);
+} // OEngine
@@ -8,6 +8,13 @@ namespace OEngine
 		return F0 + (1 - F0) * std::pow(Math::clamp((1 - cosTheta), 0.0, 1.0), 5.0);
 	}
 
+	// Fresnel of the whole environment : rough surfaces reflect less at grazing angles
+	static Vector3 FresnelSchlickRoughness(float cosTheta, const Vector3& F0, float roughness)
+	{
+		Vector3 F90(std::max(1.f - roughness, F0.x), std::max(1.f - roughness, F0.y), std::max(1.f - roughness, F0.z));
+		return F0 + (F90 - F0) * std::pow(Math::clamp(1.f - cosTheta, 0.f, 1.f), 5.f);
+	}
+
 	// ACESɫӳ
 	static float FloatAces(float value)
 	{
@@ -56,7 +63,7 @@ namespace OEngine
 		return ggx1 * ggx2;
 	}
 
-	static Vector3 GetNormalFromMap(Vector3& normal, Vector3* worldPos, Vector2* uvs, const Vector2& uv, TGAImage* normal_map)
+	static Vector3 GetNormalFromMap(Vector3& normal, const Vector3* worldPos, const Vector2* uvs, const Vector2& uv, const Vector4& duv, const Texture2D* normal_map)
 	{
 		float x1 = uvs[1][0] - uvs[0][0];
 		float y1 = uvs[1][1] - uvs[0][1];
@@ -76,7 +83,7 @@ namespace OEngine
 		t = (t - t.dotProduct(normal) * normal).normalizedCopy();
 		b = (b - b.dotProduct(normal) * normal - b.dotProduct(t) * t).normalizedCopy();
 
-		Vector3 sample = texture_sample(uv, normal_map);
+		Vector3 sample = normal_map->sample(uv, duv).to_vec3();
 		sample = Vector3(sample[0] * 2 - 1, sample[1] * 2 - 1, sample[2] * 2 - 1);
 
 		Vector3 normal_new = t * sample[0] + b * sample[1] + normal * sample[2];
@@ -93,31 +100,23 @@ namespace OEngine
 		return color;
 	}
 
-	void PBRShader::vertex_shader(int nfaces, int nvertex)
+	void PBRShader::vertex_shader(int index, shaded_vertex& out) const
 	{
-		Vector4 temp_vertex = Vector4(m_payload.model->vert(nfaces, nvertex), 1.f);
-		Vector4 temp_normal = Vector4(m_payload.model->normal(nfaces, nvertex), 1.f);
-
-		m_payload.uv_attri[nvertex] = m_payload.model->uv(nfaces, nvertex);
-		m_payload.in_texCoords[nvertex] = m_payload.uv_attri[nvertex];
-		m_payload.clipCoord_attri[nvertex] = m_mvp * temp_vertex;
-		m_payload.in_clipPos[nvertex] = m_payload.clipCoord_attri[nvertex];
+		const Model& model = *m_uniform.model;
+		Vector4 temp_vertex = Vector4(model.positions()[index], 1.f);
 
-		for (int i = 0; i < 3; i++)
-		{
-			m_payload.worldCoord_attri[nvertex][i] = temp_vertex[i];
-			m_payload.in_worldPos[nvertex][i] = temp_vertex[i];
-			m_payload.normal_attri[nvertex][i] = temp_normal[i];
-			m_payload.in_normal[nvertex][i] = temp_normal[i];
-		}
+		out.clipPos		= m_mvp * temp_vertex;
+		out.worldPos	= model.positions()[index];
+		out.normal		= model.normals()[index];
+		out.uv			= model.texcoords()[index];
 	}
 
-	Vector3 PBRShader::fragment_shader(float alpha, float gamma, float beta)
+	void PBRShader::surface(const payload& pl, float alpha, float gamma, float beta, gbuffer_texel& texel) const
 	{
-		Vector4* windowPos = m_payload.clipCoord_attri;
-		Vector3* worldPoses = m_payload.worldCoord_attri;
-		Vector3* normals = m_payload.normal_attri;
-		Vector2* uvs = m_payload.uv_attri;
+		const Vector4* windowPos = pl.clipCoord_attri;
+		const Vector3* worldPoses = pl.worldCoord_attri;
+		const Vector3* normals = pl.normal_attri;
+		const Vector2* uvs = pl.uv_attri;
 
 		float Z = 1.0 / (alpha / windowPos[0].w + gamma / windowPos[1].w + beta / windowPos[2].w);
 		Vector3 normal = (alpha * normals[0] / windowPos[0].w + gamma * normals[1] / windowPos[1].w
@@ -127,18 +126,30 @@ namespace OEngine
 		Vector3 worldPos = (alpha * worldPoses[0] / windowPos[0].w + gamma * worldPoses[1] / windowPos[1].w
 			+ beta * worldPoses[2] / windowPos[2].w) * Z;
 
-		if (m_payload.model && m_payload.model->normal_map)
-			normal = GetNormalFromMap(normal, worldPoses, uvs, uv, m_payload.model->normal_map);
+		const Texture2D* normal_map = m_uniform.model ? m_uniform.model->map(MaterialMap::Normal) : nullptr;
+		if (normal_map)
+			normal = GetNormalFromMap(normal, worldPoses, uvs, uv, pl.uv_deriv, normal_map);
 
-		Vector3 n = normal.normalizedCopy();
-		Vector3 v = (m_payload.camera->m_eye - worldPos).normalizedCopy();
+		texel.worldPos = worldPos;
+		texel.normal = normal;
+		texel.uv = uv;
+	}
+
+	Vector3 PBRShader::shade(const gbuffer_texel& texel) const
+	{
+		const Vector3& worldPos = texel.worldPos;
+		const Vector2& uv = texel.uv;
+
+		Vector3 n = texel.normal.normalizedCopy();
+		Vector3 v = (m_uniform.camera->m_eye - worldPos).normalizedCopy();
 		float NdotV = std::fmaxf(n.dotProduct(v), 0.f);
 
-		float roughness = m_payload.model->roughness(uv);
-		float metalness = m_payload.model->metalness(uv);
-		float occlusion = m_payload.model->occlusion(uv);
+		Vector3 orm = m_uniform.model->orm(uv, texel.duv);
+		float occlusion = orm.x;
+		float roughness = orm.y;
+		float metalness = orm.z;
 
-		Vector3 albedo = m_payload.model->diffuse(uv);
+		Vector3 albedo = m_uniform.model->diffuse(uv, texel.duv);
 
 		Vector3 color{ 0.f, 0.f, 0.f };
 		Vector3 lo{ 0.f, 0.f, 0.f };
@@ -174,9 +185,24 @@ namespace OEngine
 		}
 		// ڱ
 		Vector3 ambient = Vector3(0.03f) * albedo * occlusion;
+		if (m_uniform.ibl)
+		{
+			/* split sum : prefiltered radiance * (F0 * scale + bias), the LUT holds scale and bias */
+			Vector3 F0 = Vector3::lerp(Vector3(0.04f), albedo, metalness);
+			Vector3 kS = FresnelSchlickRoughness(NdotV, F0, roughness);
+			Vector3 kD = (Vector3(1.f) - kS) * (1.f - metalness);
+
+			Vector3 r = (-v).reflect(n);
+			Vector2 scale_bias = m_uniform.ibl->brdf(NdotV, roughness);
+			Vector3 specular = m_uniform.ibl->specular(r, roughness) * (F0 * scale_bias.x + Vector3(scale_bias.y));
+			Vector3 diffuse = m_uniform.ibl->diffuse(n) * albedo;
+
+			ambient = (kD * diffuse + specular) * occlusion;
+		}
 		color = ambient + lo;
 
-		color = ReinhardMapping(color)*2.5f;
+		// the lift makes up for the constant ambient, the environment already lights the surface
+		color = ReinhardMapping(color) * (m_uniform.ibl ? 1.f : 2.5f);
 
 		return color * 255.f;
 		// return { alpha * 255, gamma * 255, beta * 255 };
@@ -8,44 +8,43 @@ namespace OEngine
 		return Vector3::UNIT_SCALE;
 	}
 
-	void PhongShader::vertex_shader(int nfaces, int nvertex)
+	void PhongShader::vertex_shader(int index, shaded_vertex& out) const
 	{
-		Vector4 temp_vertex = Vector4(m_payload.model->vert(nfaces, nvertex), 1.f);
-		Vector4 temp_normal = Vector4(m_payload.model->normal(nfaces, nvertex), 1.f);
+		const Model& model = *m_uniform.model;
+		Vector4 temp_vertex = Vector4(model.positions()[index], 1.f);
 
-		m_payload.uv_attri[nvertex]			= m_payload.model->uv(nfaces, nvertex);
-		m_payload.in_texCoords[nvertex]		= m_payload.uv_attri[nvertex];
-		m_payload.clipCoord_attri[nvertex]	= m_mvp * temp_vertex;
-		m_payload.in_clipPos[nvertex]		= m_payload.clipCoord_attri[nvertex];
-
-		for (int i = 0; i < 3; i++)
-		{
-			m_payload.worldCoord_attri[nvertex][i] = temp_vertex[i];
-			m_payload.in_worldPos[nvertex][i] = temp_vertex[i];
-			m_payload.normal_attri[nvertex][i] = temp_normal[i];
-			m_payload.in_normal[nvertex][i] = temp_normal[i];
-		}
+		out.clipPos		= m_mvp * temp_vertex;
+		out.worldPos	= model.positions()[index];
+		out.normal		= model.normals()[index];
+		out.uv			= model.texcoords()[index];
 	}
 
-	Vector3 PhongShader::fragment_shader(float alpha, float gamma, float beta)
+	void PhongShader::surface(const payload& pl, float alpha, float gamma, float beta, gbuffer_texel& texel) const
 	{
 		// ݴ洢m_payloadṹ
 		
 
 		// õǷͼ
-		// if (m_payload.model->normal_map)
+		// if (m_uniform.model->normal_map)
 			// ȡֵnormal
-		Vector3* worldPos	= m_payload.worldCoord_attri;
-		Vector3* normals	= m_payload.normal_attri;
-		Vector2* texCoords	= m_payload.uv_attri;
+		const Vector3* worldPos	= pl.worldCoord_attri;
+		const Vector3* normals	= pl.normal_attri;
+		const Vector2* texCoords	= pl.uv_attri;
+
+		texel.worldPos = interpolate(alpha, gamma, beta, worldPos[0], worldPos[1], worldPos[2]);
+		texel.normal = interpolate(alpha, gamma, beta, normals[0], normals[1], normals[2]).normalizedCopy();
+		texel.uv = interpolate(alpha, gamma, beta, texCoords[0], texCoords[1], texCoords[2]);
+	}
 
-		Vector3 fragPos = interpolate(alpha, gamma, beta, worldPos[0], worldPos[1], worldPos[2]);
-		Vector3 normal = interpolate(alpha, gamma, beta, normal[0], normal[1], normal[2]).normalizedCopy();
-		Vector2 texCoord = interpolate(alpha, gamma, beta, texCoords[0], texCoords[1], texCoords[2]);
+	Vector3 PhongShader::shade(const gbuffer_texel& texel) const
+	{
+		const Vector3& fragPos = texel.worldPos;
+		const Vector3& normal = texel.normal;
+		const Vector2& texCoord = texel.uv;
 
 		Vector3 lightDir = (m_light.position - fragPos).normalizedCopy();
-		Vector3 viewDir = (m_payload.camera->m_eye - fragPos).normalizedCopy();
-		Vector3 color = m_payload.model->diffuse(texCoord);
+		Vector3 viewDir = (m_uniform.camera->m_eye - fragPos).normalizedCopy();
+		Vector3 color = m_uniform.model->diffuse(texCoord, texel.duv);
 		 
 		Vector3 halfVec = (lightDir + viewDir).normalizedCopy();
 
@@ -0,0 +1,216 @@
+#include "./resource_manager.h"
+#include "./hdr_image.h"
+
+#include <filesystem>
+
+namespace OEngine
+{
+	std::string ResourceManager::canonical_path(const std::string& path)
+	{
+		std::error_code error;
+		std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+		return error ? path : canonical.string();
+	}
+
+	Model::Ptr ResourceManager::model(const std::string& path, int is_skybox)
+	{
+		std::string key = (is_skybox ? "skybox:" : "model:") + canonical_path(path);
+		auto value = acquire(key,
+			[&path, is_skybox]() -> std::shared_ptr<void>
+			{
+				auto model = std::make_shared<Model>(path.c_str(), is_skybox);
+				return model->nfaces() > 0 ? model : nullptr;
+			},
+			[](const void* p) { return static_cast<const Model*>(p)->memory_size(); });
+		return std::static_pointer_cast<Model>(value);
+	}
+
+	std::shared_ptr<TGAImage> ResourceManager::image(const std::string& path, bool bottom_up)
+	{
+		std::string key = (bottom_up ? "tga_bu:" : "tga:") + canonical_path(path);
+		auto value = acquire(key,
+			[&path, bottom_up]() -> std::shared_ptr<void>
+			{
+				auto image = std::make_shared<TGAImage>();
+				return image->read_tga_file(path.c_str(), bottom_up) ? image : nullptr;
+			},
+			[](const void* p)
+			{
+				TGAImage* image = const_cast<TGAImage*>(static_cast<const TGAImage*>(p));
+				return (size_t)image->get_width() * image->get_height() * image->get_bytespp();
+			});
+		return std::static_pointer_cast<TGAImage>(value);
+	}
+
+	Texture2D::Ptr ResourceManager::texture(const std::string& path, TextureFormat format)
+	{
+		static const char* format_names[] = { "rgba8:", "r8:", "rgb32f:" };
+
+		// radiance files are always kept as float
+		std::string extension = std::filesystem::path(path).extension().string();
+		if (extension == ".hdr" || extension == ".HDR")
+		{
+			std::string key = std::string("tex_") + format_names[(int)TextureFormat::RGB32F] + canonical_path(path);
+			return texture(key, [&path]() -> Texture2D::Ptr
+			{
+				hdr_image image;
+				if (!read_hdr_file(path, image, true))
+					return nullptr;
+				return std::make_shared<Texture2D>(image.width, image.height, image.texels.data());
+			});
+		}
+
+		std::string key = std::string("tex_") + format_names[(int)format] + canonical_path(path);
+		return texture(key, [&path, format]() -> Texture2D::Ptr
+		{
+			// decoded straight from the file, the TGA is not worth keeping next to its texture
+			TGAImage image;
+			if (!image.read_tga_file(path.c_str(), true))
+				return nullptr;
+			return std::make_shared<Texture2D>(image, format);
+		});
+	}
+
+	Texture2D::Ptr ResourceManager::texture(const std::string& key, const std::function<Texture2D::Ptr()>& load)
+	{
+		auto value = acquire(key,
+			[&load]() -> std::shared_ptr<void> { return load(); },
+			[](const void* p) { return static_cast<const Texture2D*>(p)->memory_size(); });
+		return std::static_pointer_cast<Texture2D>(value);
+	}
+
+	/*
+	*  the first request for a key inserts a pending entry and loads outside the lock,
+	*  later requests share its future, failed loads (null or thrown) are forgotten so they can be retried,
+	*  a throwing load rethrows to every thread waiting on it
+	*/
+	std::shared_ptr<void> ResourceManager::acquire(const std::string& key, const std::function<std::shared_ptr<void>()>& load,
+		const std::function<size_t(const void*)>& size)
+	{
+		std::promise<std::shared_ptr<void> > promise;
+		std::shared_future<std::shared_ptr<void> > cached;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto found = m_entries.find(key);
+			if (found != m_entries.end())
+			{
+				m_stats.hits++;
+				m_lru.splice(m_lru.begin(), m_lru, found->second.lru);
+				cached = found->second.value;
+			}
+			else
+			{
+				m_stats.misses++;
+				m_lru.push_front(key);
+				entry& pending = m_entries[key];
+				pending.value = promise.get_future().share();
+				pending.lru = m_lru.begin();
+			}
+		}
+		// may wait for another thread's load of the same key
+		if (cached.valid())
+			return cached.get();
+
+		std::shared_ptr<void> value;
+		try
+		{
+			value = load();
+		}
+		catch (...)
+		{
+			// forgotten before the waiters wake, evict must never meet a ready future holding an exception
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				auto found = m_entries.find(key);
+				m_lru.erase(found->second.lru);
+				m_entries.erase(found);
+			}
+			promise.set_exception(std::current_exception());
+			throw;
+		}
+		promise.set_value(value);
+
+		size_t budget;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto found = m_entries.find(key);
+			if (!value)
+			{
+				m_lru.erase(found->second.lru);
+				m_entries.erase(found);
+				return nullptr;
+			}
+
+			found->second.bytes = size(value.get());
+			m_stats.bytes += found->second.bytes;
+			budget = m_budget;
+		}
+
+		if (budget > 0)
+			trim(budget);
+		return value;
+	}
+
+	/*
+	*  evicted assets are released outside the lock : a model's destructor waits for its texture
+	*  loads, which may be blocked on this manager, releasing a model can also leave its textures
+	*  unused, so eviction repeats until nothing more is dropped
+	*/
+	void ResourceManager::trim(size_t budget)
+	{
+		for (;;)
+		{
+			std::vector<std::shared_ptr<void> > dropped;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				evict(budget, dropped);
+			}
+			if (dropped.empty())
+				break;
+		}
+	}
+
+	// budget 0 : every unused entry goes
+	void ResourceManager::evict(size_t budget, std::vector<std::shared_ptr<void> >& dropped)
+	{
+		for (auto it = m_lru.end(); it != m_lru.begin() && (budget == 0 || m_stats.bytes > budget);)
+		{
+			--it;
+			auto found = m_entries.find(*it);
+			const auto& value = found->second.value;
+
+			// still loading, or someone holds a handle : dropping it would free nothing
+			if (value.wait_for(std::chrono::seconds(0)) != std::future_status::ready || value.get().use_count() > 1)
+				continue;
+
+			dropped.push_back(value.get());
+			m_stats.bytes -= found->second.bytes;
+			m_stats.evictions++;
+			m_entries.erase(found);
+			it = m_lru.erase(it);
+		}
+	}
+
+	void ResourceManager::set_budget(size_t bytes)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_budget = bytes;
+		}
+		if (bytes > 0)
+			trim(bytes);
+	}
+
+	void ResourceManager::clear_unused()
+	{
+		trim(0);
+	}
+
+	resource_stats ResourceManager::stats()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		resource_stats stats = m_stats;
+		stats.entries = m_entries.size();
+		return stats;
+	}
+} // OEngine
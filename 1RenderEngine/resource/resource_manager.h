@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <cstdint>
+
+#include "../core/base/public_singleton.h"
+#include "./model.h"
+#include "./texture2d.h"
+#include "./tgaimage.h"
+
+/*
+*  process wide cache of loaded assets, keyed by canonical path (and format)
+*     every asset is loaded once and handed out as a shared handle, concurrent requests for an
+*     asset that is still loading wait for that load instead of starting another one
+*
+*     budget : when the cached bytes exceed it, entries nobody else holds a handle to are dropped,
+*              least recently used first, assets still in use always stay (0 : unlimited)
+*/
+
+namespace OEngine
+{
+	struct resource_stats
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t evictions = 0;
+		size_t bytes = 0;			// estimated size of everything cached
+		size_t entries = 0;
+	};
+
+	class ResourceManager : public PublicSingleton<ResourceManager>
+	{
+		friend class PublicSingleton<ResourceManager>;
+	public:
+		Model::Ptr model(const std::string& path, int is_skybox = 0);
+
+		// decoded TGA, bottom_up as TGAImage::read_tga_file, null when the file can't be read
+		std::shared_ptr<TGAImage> image(const std::string& path, bool bottom_up = true);
+
+		// mipmapped texture of a TGA file, a .hdr file is always loaded as RGB32F
+		Texture2D::Ptr texture(const std::string& path, TextureFormat format = TextureFormat::RGBA8);
+		// texture built by the caller (e.g. packed from several files), key must name its sources
+		Texture2D::Ptr texture(const std::string& key, const std::function<Texture2D::Ptr()>& load);
+
+		void set_budget(size_t bytes);
+		size_t budget() const { return m_budget; }
+
+		// drops every unused entry
+		void clear_unused();
+		resource_stats stats();
+
+		static std::string canonical_path(const std::string& path);
+
+	private:
+		ResourceManager() {}
+
+		struct entry
+		{
+			std::shared_future<std::shared_ptr<void> > value;
+			size_t bytes = 0;
+			std::list<std::string>::iterator lru;
+		};
+
+		std::shared_ptr<void> acquire(const std::string& key, const std::function<std::shared_ptr<void>()>& load,
+			const std::function<size_t(const void*)>& size);
+		void trim(size_t budget);
+		// caller holds m_mutex and releases dropped after unlocking
+		void evict(size_t budget, std::vector<std::shared_ptr<void> >& dropped);
+
+		std::mutex m_mutex;
+		std::unordered_map<std::string, entry> m_entries;
+		std::list<std::string> m_lru;		// most recently used first
+		size_t m_budget = 0;
+		resource_stats m_stats;
+	};
+} // OEngine
@@ -0,0 +1,284 @@
+#include "./texture2d.h"
+#include "../core/base/hash.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace OEngine
+{
+	Texture2D::Texture2D(TGAImage& image, TextureFormat format)
+		: m_format(format)
+	{
+		int width = std::max(image.get_width(), 1);
+		int height = std::max(image.get_height(), 1);
+		allocate(0, width, height);
+
+		mip_level& base = m_levels[0];
+		int bpp = image.get_bytespp();
+		const unsigned char* data = image.buffer();
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				// TGA texels are BGR(A), missing channels read as opaque white
+				uint8_t rgba[4] = { 255, 255, 255, 255 };
+				if (data && x < image.get_width() && y < image.get_height())
+				{
+					const unsigned char* src = data + ((size_t)y * image.get_width() + x) * bpp;
+					if (bpp == TGAImage::GRAYSCALE)
+						rgba[0] = rgba[1] = rgba[2] = src[0];
+					else
+					{
+						rgba[0] = src[2];
+						rgba[1] = src[1];
+						rgba[2] = src[0];
+						if (bpp == TGAImage::RGBA)
+							rgba[3] = src[3];
+					}
+				}
+
+				uint8_t* dst = &base.storage[base.offset(x, y) * texel_bytes(format)];
+				if (format == TextureFormat::RGBA8)
+					memcpy(dst, rgba, 4);
+				else if (format == TextureFormat::R8)
+					dst[0] = rgba[0];
+				else
+				{
+					float rgb[3] = { rgba[0] / 255.f, rgba[1] / 255.f, rgba[2] / 255.f };
+					memcpy(dst, rgb, sizeof(rgb));
+				}
+			}
+		}
+
+		build_mips();
+	}
+
+	Texture2D::Texture2D(int width, int height, const uint8_t* rgba)
+		: m_format(TextureFormat::RGBA8)
+	{
+		allocate(0, width, height);
+
+		mip_level& base = m_levels[0];
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++)
+				memcpy(&base.storage[base.offset(x, y) * 4], rgba + ((size_t)y * width + x) * 4, 4);
+
+		build_mips();
+	}
+
+	Texture2D::Texture2D(int width, int height, const Vector3* texels, bool mipmaps)
+		: m_format(TextureFormat::RGB32F)
+	{
+		allocate(0, width, height);
+
+		mip_level& base = m_levels[0];
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				const Vector3& t = texels[(size_t)y * width + x];
+				float rgb[3] = { t.x, t.y, t.z };
+				memcpy(&base.storage[base.offset(x, y) * sizeof(rgb)], rgb, sizeof(rgb));
+			}
+		}
+
+		if (mipmaps)
+			build_mips();
+	}
+
+	Texture2D::Texture2D(int width, int height, TextureFormat format, const uint8_t* tiled, std::shared_ptr<const void> owner)
+		: m_format(format), m_owner(std::move(owner))
+	{
+		m_levels.resize(1);
+		mip_level& base = m_levels[0];
+		base.width = width;
+		base.height = height;
+		base.tiles_x = (width + TILE_SIZE - 1) >> TILE_BITS;
+		base.texels = tiled;
+	}
+
+	size_t Texture2D::tiled_size(int width, int height, TextureFormat format)
+	{
+		size_t tiles_x = (width + TILE_SIZE - 1) >> TILE_BITS;
+		size_t tiles_y = (height + TILE_SIZE - 1) >> TILE_BITS;
+		return tiles_x * tiles_y * TILE_SIZE * TILE_SIZE * texel_bytes(format);
+	}
+
+	int Texture2D::texel_bytes(TextureFormat format)
+	{
+		switch (format)
+		{
+		case TextureFormat::RGBA8:	return 4;
+		case TextureFormat::R8:		return 1;
+		default:					return 3 * (int)sizeof(float);
+		}
+	}
+
+	size_t Texture2D::memory_size() const
+	{
+		size_t bytes = 0;
+		for (const auto& level : m_levels)
+			bytes += level.storage.size();
+		return bytes;
+	}
+
+	// the padding of the base level is always zero, it hashes the same every time
+	uint64_t Texture2D::hash() const
+	{
+		const mip_level& base = m_levels[0];
+		int32_t shape[3] = { (int32_t)m_format, base.width, base.height };
+		return hash_bytes(base.texels, tiled_size(base.width, base.height, m_format), hash_bytes(shape, sizeof(shape)));
+	}
+
+	// levels are padded to whole tiles, the padding is never addressed
+	void Texture2D::allocate(int level, int width, int height)
+	{
+		if ((int)m_levels.size() <= level)
+			m_levels.resize(level + 1);
+
+		mip_level& mip = m_levels[level];
+		mip.width = width;
+		mip.height = height;
+		mip.tiles_x = (width + TILE_SIZE - 1) >> TILE_BITS;
+		mip.storage.assign(tiled_size(width, height, m_format), 0);
+		// growing m_levels moves the other levels' vectors, their buffers stay where they are
+		mip.texels = mip.storage.data();
+	}
+
+	void Texture2D::build_mips()
+	{
+		switch (m_format)
+		{
+		case TextureFormat::RGBA8:	build_mips_as<rgba8>(); break;
+		case TextureFormat::R8:		build_mips_as<r8>(); break;
+		default:					build_mips_as<rgb32f>(); break;
+		}
+	}
+
+	static inline uint8_t box_filter(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+	{
+		return (uint8_t)((a + b + c + d + 2) >> 2);
+	}
+
+	static inline float box_filter(float a, float b, float c, float d)
+	{
+		return (a + b + c + d) * 0.25f;
+	}
+
+	// 2x2 box filter over texels 2x, 2x + 1 : the last row / column of an odd sized level is dropped,
+	// a level 1 texel wide or high repeats it instead
+	template <typename F>
+	void Texture2D::build_mips_as()
+	{
+		typedef typename F::channel channel;
+		const int N = F::channels;
+
+		while (m_levels.back().width > 1 || m_levels.back().height > 1)
+		{
+			int level = (int)m_levels.size();
+			allocate(level, std::max(m_levels[level - 1].width / 2, 1), std::max(m_levels[level - 1].height / 2, 1));
+			const mip_level& src = m_levels[level - 1];
+			mip_level& dst = m_levels[level];
+
+			for (int y = 0; y < dst.height; y++)
+			{
+				int y0 = std::min(y * 2, src.height - 1);
+				int y1 = std::min(y * 2 + 1, src.height - 1);
+				for (int x = 0; x < dst.width; x++)
+				{
+					int x0 = std::min(x * 2, src.width - 1);
+					int x1 = std::min(x * 2 + 1, src.width - 1);
+
+					channel t00[N], t01[N], t10[N], t11[N], out[N];
+					memcpy(t00, &src.texels[src.offset(x0, y0) * sizeof(t00)], sizeof(t00));
+					memcpy(t01, &src.texels[src.offset(x1, y0) * sizeof(t01)], sizeof(t01));
+					memcpy(t10, &src.texels[src.offset(x0, y1) * sizeof(t10)], sizeof(t10));
+					memcpy(t11, &src.texels[src.offset(x1, y1) * sizeof(t11)], sizeof(t11));
+					for (int c = 0; c < N; c++)
+						out[c] = box_filter(t00[c], t01[c], t10[c], t11[c]);
+					memcpy(&dst.storage[dst.offset(x, y) * sizeof(out)], out, sizeof(out));
+				}
+			}
+		}
+	}
+
+	// log2 of the texel footprint of one pixel step, negative when magnified
+	float Texture2D::lod(const Vector4& duv) const
+	{
+		float dudx = duv.x * m_levels[0].width, dvdx = duv.y * m_levels[0].height;
+		float dudy = duv.z * m_levels[0].width, dvdy = duv.w * m_levels[0].height;
+		float footprint = std::max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+		return footprint > 0.f ? 0.5f * std::log2(footprint) : 0.f;
+	}
+
+	static inline int wrap(int i, int size)
+	{
+		i %= size;
+		return i < 0 ? i + size : i;
+	}
+
+	Vector4 Texture2D::fetch(int level, int x, int y) const
+	{
+		const mip_level& mip = m_levels[level];
+		const uint8_t* t = &mip.texels[mip.offset(wrap(x, mip.width), wrap(y, mip.height)) * texel_bytes(m_format)];
+		switch (m_format)
+		{
+		case TextureFormat::RGBA8:	return rgba8::decode(t);
+		case TextureFormat::R8:		return r8::decode(t);
+		default:					return rgb32f::decode(t);
+		}
+	}
+
+	Vector4 Texture2D::sample_nearest(const Vector2& uv, int level) const
+	{
+		const mip_level& mip = m_levels[level];
+		return fetch(level, (int)std::floor(uv.x * mip.width), (int)std::floor(uv.y * mip.height));
+	}
+
+	template <typename F>
+	Vector4 Texture2D::bilinear(const Vector2& uv, int level) const
+	{
+		const mip_level& mip = m_levels[level];
+		const size_t bytes = sizeof(typename F::channel) * F::channels;
+
+		// texel centers sit at half integers
+		float x = uv.x * mip.width - 0.5f;
+		float y = uv.y * mip.height - 0.5f;
+		float fx = std::floor(x), fy = std::floor(y);
+		float tx = x - fx, ty = y - fy;
+		int x0 = wrap((int)fx, mip.width), y0 = wrap((int)fy, mip.height);
+		int x1 = x0 + 1 < mip.width ? x0 + 1 : 0;
+		int y1 = y0 + 1 < mip.height ? y0 + 1 : 0;
+
+		const uint8_t* texels = mip.texels;
+		Vector4 t00 = F::decode(texels + mip.offset(x0, y0) * bytes);
+		Vector4 t01 = F::decode(texels + mip.offset(x1, y0) * bytes);
+		Vector4 t10 = F::decode(texels + mip.offset(x0, y1) * bytes);
+		Vector4 t11 = F::decode(texels + mip.offset(x1, y1) * bytes);
+
+		Vector4 top = Vector4::lerp(t00, t01, tx);
+		Vector4 bottom = Vector4::lerp(t10, t11, tx);
+		return Vector4::lerp(top, bottom, ty);
+	}
+
+	Vector4 Texture2D::sample_bilinear(const Vector2& uv, int level) const
+	{
+		switch (m_format)
+		{
+		case TextureFormat::RGBA8:	return bilinear<rgba8>(uv, level);
+		case TextureFormat::R8:		return bilinear<r8>(uv, level);
+		default:					return bilinear<rgb32f>(uv, level);
+		}
+	}
+
+	Vector4 Texture2D::sample_trilinear(const Vector2& uv, float lod) const
+	{
+		lod = std::min(std::max(lod, 0.f), (float)(levels() - 1));
+		int level = (int)lod;
+		float t = lod - level;
+		if (t == 0.f || level + 1 >= levels())
+			return sample_bilinear(uv, level);
+
+		return Vector4::lerp(sample_bilinear(uv, level), sample_bilinear(uv, level + 1), t);
+	}
+} // OEngine
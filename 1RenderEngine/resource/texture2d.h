@@ -0,0 +1,125 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+#include "../core/math/math_headers.h"
+#include "./tgaimage.h"
+
+/*
+*  material texture with a full mip chain, built once at load time
+*     every level halves the size down to 1x1, addressing repeats, colors come back in [0, 1]
+*     (R8 comes back as (r, r, r, 1), RGB32F as (r, g, b, 1) and is not clamped)
+*
+*     storage : fixed texel formats, texels laid out in 4x4 tiles (tiles row major, texels row major
+*               inside a tile), an RGBA8 tile is one 64 byte cache line, so the 2x2 footprint of a
+*               bilinear fetch and the vertical neighbours of a quad mostly hit the same line
+*
+*     sample(uv, duv) : trilinear, the level comes from the screen space uv derivatives
+*                       (du/dx, dv/dx, du/dy, dv/dy) the rasterizer computes per 2x2 quad,
+*                       zero derivatives sample level 0 bilinearly
+*/
+
+namespace OEngine
+{
+	enum class TextureFormat
+	{
+		RGBA8,
+		R8,			// single channel maps : roughness, metalness, occlusion
+		RGB32F		// linear float color, no conversion on fetch
+	};
+
+	class Texture2D
+	{
+	public:
+		typedef std::shared_ptr<Texture2D> Ptr;
+
+		static const int TILE_BITS = 2;
+		static const int TILE_SIZE = 1 << TILE_BITS;
+
+		// converts from the TGA's BGR(A) / grayscale layout, R8 keeps the red (or gray) channel
+		explicit Texture2D(TGAImage& image, TextureFormat format = TextureFormat::RGBA8);
+		// RGBA8 from row major r, g, b, a bytes
+		Texture2D(int width, int height, const uint8_t* rgba);
+		// RGB32F from row major texels, mipmaps = false keeps level 0 only
+		Texture2D(int width, int height, const Vector3* texels, bool mipmaps = true);
+		/*
+		*  level 0 only, viewing texels already in the tiled layout (tiled_size bytes, as level_data
+		*  hands them out), nothing is copied, owner keeps that memory alive (e.g. a mapped file)
+		*/
+		Texture2D(int width, int height, TextureFormat format, const uint8_t* tiled, std::shared_ptr<const void> owner);
+
+		// bytes of one tiled level
+		static size_t tiled_size(int width, int height, TextureFormat format);
+
+		TextureFormat format() const { return m_format; }
+		int width(int level = 0) const { return m_levels[level].width; }
+		int height(int level = 0) const { return m_levels[level].height; }
+		int levels() const { return (int)m_levels.size(); }
+		// bytes of texel storage, all levels, memory viewed from elsewhere doesn't count
+		size_t memory_size() const;
+		// tiled texels of a level, tiled_size(width(level), height(level), format()) bytes
+		const uint8_t* level_data(int level = 0) const { return m_levels[level].texels; }
+		// of the format, size and base level texels, equal for textures built from the same image
+		uint64_t hash() const;
+
+		float lod(const Vector4& duv) const;
+
+		Vector4 fetch(int level, int x, int y) const;
+		Vector4 sample_nearest(const Vector2& uv, int level = 0) const;
+		Vector4 sample_bilinear(const Vector2& uv, int level = 0) const;
+		Vector4 sample_trilinear(const Vector2& uv, float lod) const;
+		Vector4 sample(const Vector2& uv, const Vector4& duv) const { return sample_trilinear(uv, lod(duv)); }
+
+	private:
+		struct mip_level
+		{
+			int width, height;
+			int tiles_x;
+			std::vector<uint8_t> storage;	// owned texels, empty when viewing external memory
+			const uint8_t* texels;			// tiled, texel_bytes(format) per texel
+
+			// byte offset / texel size of texel (x, y), x and y already wrapped
+			size_t offset(int x, int y) const
+			{
+				return ((size_t)((y >> TILE_BITS) * tiles_x + (x >> TILE_BITS)) << (2 * TILE_BITS))
+					+ ((y & (TILE_SIZE - 1)) << TILE_BITS) + (x & (TILE_SIZE - 1));
+			}
+		};
+
+		/*
+		*  texel formats : channel type and count, decode turns a stored texel into a Vector4
+		*/
+		struct rgba8
+		{
+			typedef uint8_t channel;
+			static const int channels = 4;
+			static Vector4 decode(const uint8_t* p) { return Vector4(p[0], p[1], p[2], p[3]) / 255.f; }
+		};
+		struct r8
+		{
+			typedef uint8_t channel;
+			static const int channels = 1;
+			static Vector4 decode(const uint8_t* p) { float r = p[0] / 255.f; return Vector4(r, r, r, 1.f); }
+		};
+		struct rgb32f
+		{
+			typedef float channel;
+			static const int channels = 3;
+			static Vector4 decode(const uint8_t* p) { float c[3]; memcpy(c, p, sizeof(c)); return Vector4(c[0], c[1], c[2], 1.f); }
+		};
+
+		static int texel_bytes(TextureFormat format);
+
+		void allocate(int level, int width, int height);
+		void build_mips();
+		template <typename F> void build_mips_as();
+		template <typename F> Vector4 bilinear(const Vector2& uv, int level) const;
+
+		TextureFormat m_format;
+		std::vector<mip_level> m_levels;
+		std::shared_ptr<const void> m_owner;	// external memory level 0 views, if any
+	};
+} // OEngine
@@ -40,7 +40,7 @@ TGAImage & TGAImage::operator =(const TGAImage &img) {
 	return *this;
 }
 
-bool TGAImage::read_tga_file(const char *filename) {
+bool TGAImage::read_tga_file(const char *filename, bool bottom_up) {
 	if (data) delete [] data;
 	data = NULL;
 	std::ifstream in;
@@ -67,15 +67,22 @@ bool TGAImage::read_tga_file(const char *filename) {
 	}
 	unsigned long nbytes = bytespp*width*height;
 	data = new unsigned char[nbytes];
+	// rows are stored bottom row first unless bit 5 is set
+	bool flip = ((header.imagedescriptor & 0x20) != 0) == bottom_up;
 	if (3==header.datatypecode || 2==header.datatypecode) {
-		in.read((char *)data, nbytes);
-		if (!in.good()) {
-			in.close();
-			std::cerr << "an error occured while reading the data\n";
-			return false;
+		// uncompressed rows are read straight into their flipped place
+		unsigned long bytes_per_line = width*bytespp;
+		for (int j=0; j<height; j++) {
+			in.read((char *)(data + (flip ? height-1-j : j)*bytes_per_line), bytes_per_line);
+			if (!in.good()) {
+				in.close();
+				std::cerr << "an error occured while reading the data\n";
+				return false;
+			}
 		}
 	} else if (10==header.datatypecode||11==header.datatypecode) {
-		if (!load_rle_data(in)) {
+		// runs are expanded straight into their flipped rows
+		if (!load_rle_data(in, flip)) {
 			in.close();
 			std::cerr << "an error occured while reading the data\n";
 			return false;
@@ -85,9 +92,6 @@ bool TGAImage::read_tga_file(const char *filename) {
 		std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
 		return false;
 	}
-	if (!(header.imagedescriptor & 0x20)) {
-		flip_vertically();
-	}
 	if (header.imagedescriptor & 0x10) {
 		flip_horizontally();
 	}
@@ -96,11 +100,23 @@ bool TGAImage::read_tga_file(const char *filename) {
 	return true;
 }
 
-bool TGAImage::load_rle_data(std::ifstream &in) {
+bool TGAImage::load_rle_data(std::ifstream &in, bool flip) {
 	unsigned long pixelcount = width*height;
 	unsigned long currentpixel = 0;
-	unsigned long currentbyte  = 0;
+	unsigned long bytes_per_line = width*bytespp;
+	int x = 0, y = 0;
+	unsigned char *row = data + (flip ? height-1 : 0)*bytes_per_line;
 	TGAColor colorbuffer;
+	// one pixel at the decode position, rows advance in destination order
+	auto put_pixel = [&]() {
+		memcpy(row + x*bytespp, colorbuffer.raw, bytespp);
+		if (++x==width) {
+			x = 0;
+			if (++y<height)
+				row = data + (flip ? height-1-y : y)*bytes_per_line;
+		}
+		currentpixel++;
+	};
 	do {
 		unsigned char chunkheader = 0;
 		chunkheader = in.get();
@@ -116,13 +132,11 @@ bool TGAImage::load_rle_data(std::ifstream &in) {
 					std::cerr << "an error occured while reading the header\n";
 					return false;
 				}
-				for (int t=0; t<bytespp; t++)
-					data[currentbyte++] = colorbuffer.raw[t];
-				currentpixel++;
-				if (currentpixel>pixelcount) {
+				if (currentpixel>=pixelcount) {
 					std::cerr << "Too many pixels read\n";
 					return false;
 				}
+				put_pixel();
 			}
 		} else {
 			chunkheader -= 127;
@@ -132,13 +146,11 @@ bool TGAImage::load_rle_data(std::ifstream &in) {
 				return false;
 			}
 			for (int i=0; i<chunkheader; i++) {
-				for (int t=0; t<bytespp; t++)
-					data[currentbyte++] = colorbuffer.raw[t];
-				currentpixel++;
-				if (currentpixel>pixelcount) {
+				if (currentpixel>=pixelcount) {
 					std::cerr << "Too many pixels read\n";
 					return false;
 				}
+				put_pixel();
 			}
 		}
 	} while (currentpixel < pixelcount);
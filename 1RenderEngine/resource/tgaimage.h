@@ -69,7 +69,8 @@ protected:
 	int height;
 	int bytespp;
 
-	bool   load_rle_data(std::ifstream &in);
+	// flip : the first stored row is the last row of data
+	bool   load_rle_data(std::ifstream &in, bool flip);
 	bool unload_rle_data(std::ofstream &out);
 public:
 	enum Format {
@@ -79,7 +80,8 @@ public:
 	TGAImage();
 	TGAImage(int w, int h, int bpp);
 	TGAImage(const TGAImage &img);
-	bool read_tga_file(const char *filename);
+	// bottom_up : first row of the buffer is the bottom of the image (texture space, v = 0)
+	bool read_tga_file(const char *filename, bool bottom_up = false);
 	bool write_tga_file(const char *filename, bool rle=true);
 	bool flip_horizontally();
 	bool flip_vertically();